@@ -12,7 +12,8 @@ DockItem {
     iconName: model.iconName ? model.iconName : "application-x-desktop"
     isActive: model.isActive
     popupText: model.visibleName
-    enableActivateDot: windowCount !== 0
+    enableActivateDot: windowCount !== 0 || isLaunching
+    isLaunching: model.launching
     draggable: !model.fixed
     dragItemIndex: index
 
@@ -57,6 +58,15 @@ DockItem {
         updateGeometry()
     }
 
+    // Pull the program into the page cache while the pointer rests on it.
+    Timer {
+        id: preWarmTimer
+        interval: 400
+        running: Settings.preWarmEnabled && mouseArea.containsMouse
+                 && windowCount === 0 && model.isPinned
+        onTriggered: appModel.preWarm(model.appId)
+    }
+
     Timer {
         id: dropTimer
         interval: 300
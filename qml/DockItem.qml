@@ -23,6 +23,7 @@ Item {
 
     property bool enableActivateDot: true
     property bool isActive: false
+    property bool isLaunching: false
 
     property var popupText
 
@@ -164,6 +165,25 @@ Item {
         x: isLeft ? leftX : isBottom ? bottomX : rightX
         y: isLeft ? leftY : isBottom ? bottomY : rightY
 
+        // Pulse until the first window shows up.
+        SequentialAnimation on opacity {
+            running: control.isLaunching
+            loops: Animation.Infinite
+            alwaysRunToEnd: true
+
+            NumberAnimation {
+                to: 0.2
+                duration: 500
+                easing.type: Easing.InOutSine
+            }
+
+            NumberAnimation {
+                to: 1
+                duration: 500
+                easing.type: Easing.InOutSine
+            }
+        }
+
         Behavior on width {
             NumberAnimation {
                 duration: isBottom ? 250 : 0
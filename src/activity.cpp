@@ -19,11 +19,7 @@
 
 #include "activity.h"
 #include "docksettings.h"
-
-#include <NETWM>
-#include <KWindowSystem>
-#include <KX11Extras>
-#include <KWindowInfo>
+#include "windowbackend.h"
 
 static Activity *SELF = nullptr;
 
@@ -41,8 +37,8 @@ Activity::Activity(QObject *parent)
 {
     onActiveWindowChanged();
 
-    connect(KX11Extras::self(), &KX11Extras::activeWindowChanged, this, &Activity::onActiveWindowChanged);
-    connect(KX11Extras::self(), &KX11Extras::windowChanged,
+    connect(WindowBackend::self(), &WindowBackend::activeChanged, this, &Activity::onActiveWindowChanged);
+    connect(WindowBackend::self(), &WindowBackend::windowChanged,
             this, &Activity::onActiveWindowChanged);
 }
 
@@ -58,22 +54,21 @@ bool Activity::launchPad() const
 #include <QDebug>
 void Activity::onActiveWindowChanged()
 {
-    KWindowInfo info(KX11Extras::activeWindow(),
-                     NET::WMState | NET::WMVisibleName,
-                     NET::WM2WindowClass);
+    WindowBackend *backend = WindowBackend::self();
+    const WindowBackend::WindowProperties info = backend->properties(backend->activeWindow());
 
-    bool launchPad = info.windowClassClass() == "lingmo-launcher";
+    bool launchPad = info.windowClass == "lingmo-launcher";
 
     if (DockSettings::self()->visibility() == DockSettings::IntellHide) {
         bool existsWindowMaximized = false;
 
-        for (WId wid : KX11Extras::windows()) {
-            KWindowInfo i(wid, NET::WMState, NET::WM2WindowClass);
+        for (quint64 wid : backend->windows()) {
+            const NET::States state = backend->properties(wid).state;
 
-            if (i.isMinimized() || i.hasState(NET::SkipTaskbar))
+            if (state & (NET::Hidden | NET::SkipTaskbar))
                 continue;
 
-            if (i.hasState(NET::MaxVert) || i.hasState(NET::MaxHoriz)) {
+            if (state & (NET::MaxVert | NET::MaxHoriz)) {
                 existsWindowMaximized = true;
                 break;
             }
@@ -90,6 +85,6 @@ void Activity::onActiveWindowChanged()
         emit launchPadChanged();
     }
 
-    m_pid = info.pid();
-    m_windowClass = info.windowClassClass().toLower();
+    m_pid = info.pid;
+    m_windowClass = QString(info.windowClass).toLower();
 }
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "appindexcache.h"
+
+#include <QDataStream>
+#include <QStandardPaths>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+
+// Bump whenever the layout below changes.
+static const quint32 CacheMagic = 0x4c444149; // "LDAI"
+static const quint32 CacheVersion = 3;
+
+static QDataStream &operator<<(QDataStream &out, const AppIndexCache::Record &record)
+{
+    const SystemAppMonitor::ParsedEntry &entry = record.entry;
+
+    out << entry.path
+        << record.stat.mtime << record.stat.size << record.stat.inode
+        << entry.visible;
+
+    // Hidden entries only need their stat data.
+    if (entry.visible) {
+        out << entry.name << entry.genericName << entry.comment
+            << entry.iconName << entry.startupWMClass
+            << entry.exec << entry.argv;
+    }
+
+    return out;
+}
+
+static QDataStream &operator>>(QDataStream &in, AppIndexCache::Record &record)
+{
+    SystemAppMonitor::ParsedEntry &entry = record.entry;
+
+    in >> entry.path
+       >> record.stat.mtime >> record.stat.size >> record.stat.inode
+       >> entry.visible;
+
+    if (entry.visible) {
+        in >> entry.name >> entry.genericName >> entry.comment
+           >> entry.iconName >> entry.startupWMClass
+           >> entry.exec >> entry.argv;
+    }
+
+    return in;
+}
+
+AppIndexCache::AppIndexCache(const QString &locale, const QStringList &desktops,
+                             const QStringList &roots)
+    : m_fileName(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+                 + "/lingmo-dock/applications.cache")
+    , m_locale(locale)
+    , m_desktops(desktops)
+    , m_roots(roots)
+{
+
+}
+
+bool AppIndexCache::load(QHash<QString, qint64> *dirs, QList<Record> *records) const
+{
+    QFile file(m_fileName);
+
+    if (!file.open(QIODevice::ReadOnly) || file.size() == 0)
+        return false;
+
+    uchar *data = file.map(0, file.size());
+
+    if (!data)
+        return false;
+
+    const QByteArray raw = QByteArray::fromRawData(reinterpret_cast<const char *>(data), file.size());
+    QDataStream in(raw);
+    in.setVersion(QDataStream::Qt_6_0);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    QString locale;
+    QStringList desktops;
+    QStringList roots;
+    quint32 count = 0;
+
+    in >> magic >> version;
+
+    bool ok = in.status() == QDataStream::Ok && magic == CacheMagic && version == CacheVersion;
+
+    if (ok) {
+        // Names and visibility depend on the first two,
+        // shadowing on the folders and their order.
+        in >> locale >> desktops >> roots;
+        ok = locale == m_locale && desktops == m_desktops && roots == m_roots;
+    }
+
+    if (ok) {
+        in >> *dirs >> count;
+        // Guard against garbage counts before reserving.
+        ok = in.status() == QDataStream::Ok && count <= quint32(raw.size());
+    }
+
+    if (ok) {
+        records->reserve(count);
+
+        for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+            Record record;
+            in >> record;
+            records->append(record);
+        }
+
+        ok = in.status() == QDataStream::Ok && in.atEnd();
+    }
+
+    file.unmap(data);
+
+    if (!ok) {
+        dirs->clear();
+        records->clear();
+    }
+
+    return ok;
+}
+
+bool AppIndexCache::save(const QHash<QString, qint64> &dirs, const QList<Record> &records) const
+{
+    if (!QDir().mkpath(QFileInfo(m_fileName).absolutePath()))
+        return false;
+
+    // Written to a temporary file and renamed into place.
+    QSaveFile file(m_fileName);
+
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_6_0);
+
+    out << CacheMagic << CacheVersion
+        << m_locale << m_desktops << m_roots
+        << dirs << quint32(records.size());
+
+    for (const Record &record : records)
+        out << record;
+
+    if (out.status() != QDataStream::Ok) {
+        file.cancelWriting();
+        return false;
+    }
+
+    return file.commit();
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef APPINDEXCACHE_H
+#define APPINDEXCACHE_H
+
+#include "systemappmonitor.h"
+
+// On-disk copy of the parsed application index, so that the dock
+// does not need to parse every .desktop file on each login.
+//
+// The cache is only trusted as far as its stat data goes, the monitor
+// still checks every directory and file against it before use.
+class AppIndexCache
+{
+public:
+    struct Record {
+        SystemAppMonitor::EntryStat stat;
+        SystemAppMonitor::ParsedEntry entry;
+    };
+
+    explicit AppIndexCache(const QString &locale, const QStringList &desktops,
+                           const QStringList &roots);
+
+    QString fileName() const { return m_fileName; }
+
+    bool load(QHash<QString, qint64> *dirs, QList<Record> *records) const;
+    bool save(const QHash<QString, qint64> &dirs, const QList<Record> &records) const;
+
+private:
+    QString m_fileName;
+    QString m_locale;
+    QStringList m_desktops;
+    QStringList m_roots;
+};
+
+#endif // APPINDEXCACHE_H
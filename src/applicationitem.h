@@ -33,9 +33,15 @@ public:
     QString visibleName;
     QString desktopPath;
     QString exec;
+    // Tokenized exec, filled from the desktop entry or on first launch.
+    QStringList argv;
 
     QList<quint64> wids;
 
+    // Startup notification id of a launch that has not mapped a window yet.
+    QByteArray startupId;
+    QElapsedTimer launchTimer;
+
     int currentActive = 0;
     bool isActive = false;
     bool isPinned = false;
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "applicationitempool.h"
+
+#include <functional>
+
+ApplicationItem *ApplicationItemPool::acquire()
+{
+    Chunk *chunk = nullptr;
+
+    for (const auto &c : m_chunks) {
+        if (c->freeCount > 0) {
+            chunk = c.get();
+            break;
+        }
+    }
+
+    if (!chunk) {
+        m_chunks.emplace_back(new Chunk);
+        chunk = m_chunks.back().get();
+        chunk->freeCount = ChunkSize;
+
+        // Hand out the lowest slots first.
+        for (int i = 0; i < ChunkSize; ++i)
+            chunk->free[i] = ChunkSize - 1 - i;
+    }
+
+    ++m_live;
+    return &chunk->items[chunk->free[--chunk->freeCount]];
+}
+
+void ApplicationItemPool::release(ApplicationItem *item)
+{
+    if (!item)
+        return;
+
+    const std::less<const ApplicationItem *> less;
+
+    for (auto it = m_chunks.begin(); it != m_chunks.end(); ++it) {
+        Chunk *chunk = it->get();
+
+        if (less(item, chunk->items) || !less(item, chunk->items + ChunkSize))
+            continue;
+
+        // Drops the strings and lists right away, the slot is reused as is.
+        *item = ApplicationItem();
+        chunk->free[chunk->freeCount++] = int(item - chunk->items);
+        --m_live;
+
+        if (chunk->freeCount == ChunkSize)
+            m_chunks.erase(it);
+
+        return;
+    }
+
+    Q_ASSERT_X(false, "ApplicationItemPool::release", "item not from this pool");
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef APPLICATIONITEMPOOL_H
+#define APPLICATIONITEMPOOL_H
+
+#include "applicationitem.h"
+
+#include <memory>
+#include <vector>
+
+// Owns every ApplicationItem of the model. Items live in fixed-size
+// chunks, so their addresses stay valid until they are released, and
+// a chunk is freed as soon as nothing in it is used any more.
+class ApplicationItemPool
+{
+public:
+    ApplicationItemPool() = default;
+    Q_DISABLE_COPY(ApplicationItemPool)
+
+    ApplicationItem *acquire();
+    void release(ApplicationItem *item);
+
+    int liveCount() const { return m_live; }
+    int allocatedCount() const { return int(m_chunks.size()) * ChunkSize; }
+
+private:
+    static const int ChunkSize = 16;
+
+    struct Chunk {
+        ApplicationItem items[ChunkSize];
+        int free[ChunkSize];
+        int freeCount;
+    };
+
+    std::vector<std::unique_ptr<Chunk>> m_chunks;
+    int m_live = 0;
+};
+
+#endif // APPLICATIONITEMPOOL_H
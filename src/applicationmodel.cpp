@@ -19,22 +19,73 @@
 
 #include "applicationmodel.h"
 #include "processprovider.h"
+#include "desktopfileparser.h"
+#include "docksettings.h"
+#include "prewarmer.h"
 #include "utils.h"
 
+#include <QLocale>
 #include <QProcess>
 
+#include <algorithm>
+
+// How long a launch may take to map its first window.
+static const int LaunchTimeout = 15000;
+// Icon geometries wait this long for the next update, but no longer
+// than MaxGeometryDelay in total, e.g. during a drag.
+static const int GeometryDelay = 32;
+static const int MaxGeometryDelay = 250;
+
+// Several items may share a key, the first one in row order wins,
+// just like the linear lookups used to behave.
+static ApplicationItem *firstInRowOrder(const QMultiHash<QString, ApplicationItem *> &index,
+                                        const QHash<ApplicationItem *, int> &rows,
+                                        const QString &key)
+{
+    ApplicationItem *result = nullptr;
+    const auto range = index.equal_range(key);
+
+    for (auto it = range.first; it != range.second; ++it) {
+        if (!result || rows.value(*it) < rows.value(result))
+            result = *it;
+    }
+
+    return result;
+}
+
 ApplicationModel::ApplicationModel(QObject *parent)
     : QAbstractListModel(parent)
-    , m_iface(XWindowInterface::instance())
+    , m_iface(WindowBackend::self())
     , m_sysAppMonitor(SystemAppMonitor::self())
+    , m_activeItem(nullptr)
+    , m_activeWindow(0)
+    , m_activeChanged(false)
+    , m_flushTimer(new QTimer(this))
+    , m_geometryTimer(new QTimer(this))
+    , m_pinnedStore([this] { return pinnedEntries(); })
 {
-    connect(m_iface, &XWindowInterface::windowAdded, this, &ApplicationModel::onWindowAdded);
-    connect(m_iface, &XWindowInterface::windowRemoved, this, &ApplicationModel::onWindowRemoved);
-    connect(m_iface, &XWindowInterface::activeChanged, this, &ApplicationModel::onActiveChanged);
+    m_geometryTimer->setSingleShot(true);
+    m_geometryTimer->setInterval(GeometryDelay);
+    connect(m_geometryTimer, &QTimer::timeout, this, &ApplicationModel::flushIconGeometries);
+
+    m_flushTimer->setSingleShot(true);
+    m_flushTimer->setInterval(16);
+    connect(m_flushTimer, &QTimer::timeout, this, &ApplicationModel::flushWindowEvents);
+
+    connect(m_iface, &WindowBackend::windowAdded, this, &ApplicationModel::onWindowAdded);
+    connect(m_iface, &WindowBackend::windowsAdded, this, &ApplicationModel::onWindowsAdded);
+    connect(m_iface, &WindowBackend::windowRemoved, this, &ApplicationModel::onWindowRemoved);
+    connect(m_iface, &WindowBackend::activeChanged, this, &ApplicationModel::onActiveChanged);
+    connect(m_iface, &WindowBackend::startupFinished, this, [=] (const QByteArray &id) {
+        finishLaunch(id, true);
+    });
+    connect(ProcessProvider::self(), &ProcessProvider::launchFinished, this, &ApplicationModel::launchFinished);
+    connect(ProcessProvider::self(), &ProcessProvider::launchFinished, this, &ApplicationModel::onLaunchFinished);
+    connect(m_sysAppMonitor, &SystemAppMonitor::applicationsChanged, this, &ApplicationModel::onApplicationsChanged);
 
     initPinnedApplications();
 
-    QTimer::singleShot(100, m_iface, &XWindowInterface::startInitWindows);
+    QTimer::singleShot(100, m_iface, &WindowBackend::startInitWindows);
 }
 
 int ApplicationModel::rowCount(const QModelIndex &parent) const
@@ -55,6 +106,7 @@ QHash<int, QByteArray> ApplicationModel::roleNames() const
     roles[IsPinnedRole] = "isPinned";
     roles[DesktopFileRole] = "desktopFile";
     roles[FixedItemRole] = "fixed";
+    roles[LaunchingRole] = "launching";
     return roles;
 }
 
@@ -82,6 +134,8 @@ QVariant ApplicationModel::data(const QModelIndex &index, int role) const
         return item->desktopPath;
     case FixedItemRole:
         return item->fixed;
+    case LaunchingRole:
+        return !item->startupId.isEmpty();
     default:
         return QVariant();
     }
@@ -99,11 +153,8 @@ void ApplicationModel::addItem(const QString &desktopFile)
     }
 
     beginInsertRows(QModelIndex(), rowCount(), rowCount());
-    ApplicationItem *item = new ApplicationItem;
-    QMap<QString, QString> desktopInfo = Utils::instance()->readInfoFromDesktop(desktopFile);
-    item->iconName = desktopInfo.value("Icon");
-    item->visibleName = desktopInfo.value("Name");
-    item->exec = desktopInfo.value("Exec");
+    ApplicationItem *item = m_items.acquire();
+    readDesktopInfo(item, desktopFile);
     item->desktopPath = desktopFile;
     item->isPinned = true;
 
@@ -113,7 +164,7 @@ void ApplicationModel::addItem(const QString &desktopFile)
     QFileInfo fi(desktopFile);
     item->id = fi.baseName();
 
-    m_appItems << item;
+    appendItem(item);
     endInsertRows();
 
     savePinAndUnPinList();
@@ -196,23 +247,80 @@ bool ApplicationModel::openNewInstance(const QString &appId)
     if (!item)
         return false;
 
-    if (!item->exec.isEmpty()) {
-        QStringList args = item->exec.split(" ");
-        QString exec = args.first();
-        args.removeFirst();
+    // Still waiting for the previous launch to map a window.
+    if (!item->startupId.isEmpty())
+        return false;
 
-        if (!args.isEmpty()) {
-            ProcessProvider::startDetached(exec, args);
-        } else {
-            ProcessProvider::startDetached(exec);
-        }
-    } else {
-        ProcessProvider::startDetached(appId);
-    }
+    resolveArgv(item);
+
+    const QStringList argv = item->argv.isEmpty() ? QStringList(appId) : item->argv;
+    const QByteArray startupId = m_iface->createStartupId();
+
+    m_iface->sendStartup(startupId, item->visibleName, item->iconName, item->desktopPath, argv.first());
+
+    item->startupId = startupId;
+    item->launchTimer.start();
+    m_launches.insert(startupId, item);
+    handleDataChangedFromItem(item, { LaunchingRole });
+
+    ProcessProvider::self()->launch(appId, argv, { "DESKTOP_STARTUP_ID=" + QString::fromUtf8(startupId) });
+
+    // Some programs never map a window, e.g. when they hand over
+    // to an instance that is already running elsewhere.
+    QTimer::singleShot(LaunchTimeout, this, [=] {
+        finishLaunch(startupId, false);
+    });
 
     return true;
 }
 
+void ApplicationModel::preWarm(const QString &appId)
+{
+    if (!DockSettings::self()->preWarmEnabled())
+        return;
+
+    ApplicationItem *item = findItemById(appId);
+
+    // Only worth it for pinned items that are not running yet.
+    if (!item || !item->isPinned || !item->wids.isEmpty() || !item->startupId.isEmpty())
+        return;
+
+    resolveArgv(item);
+
+    const QString program = item->argv.value(DesktopFileParser::programIndex(item->argv));
+
+    if (!program.isEmpty())
+        Prewarmer::self()->warm(program);
+}
+
+QVariantMap ApplicationModel::itemStats() const
+{
+    QVariantMap stats;
+    stats.insert("live", m_items.liveCount());
+    stats.insert("allocated", m_items.allocatedCount());
+    return stats;
+}
+
+QVariantMap ApplicationModel::launchMetrics() const
+{
+    QVariantMap metrics;
+
+    for (auto it = m_launchStats.constBegin(); it != m_launchStats.constEnd(); ++it) {
+        const LaunchStats &stats = it.value();
+        const int mapped = stats.count - stats.failures;
+
+        QVariantMap app;
+        app.insert("count", stats.count);
+        app.insert("failures", stats.failures);
+        app.insert("last", stats.last);
+        app.insert("average", mapped > 0 ? stats.total / mapped : 0);
+        app.insert("max", stats.max);
+        metrics.insert(it.key(), app);
+    }
+
+    return metrics;
+}
+
 void ApplicationModel::closeAllByAppId(const QString &appId)
 {
     ApplicationItem *item = findItemById(appId);
@@ -234,7 +342,7 @@ void ApplicationModel::pin(const QString &appId)
 
     item->isPinned = true;
 
-    handleDataChangedFromItem(item);
+    handleDataChangedFromItem(item, { IsPinnedRole });
     savePinAndUnPinList();
 }
 
@@ -246,14 +354,14 @@ void ApplicationModel::unPin(const QString &appId)
         return;
 
     item->isPinned = false;
-    handleDataChangedFromItem(item);
+    handleDataChangedFromItem(item, { IsPinnedRole });
 
     // Need to be removed after unpin
     if (item->wids.isEmpty()) {
-        int index = indexOf(item->id);
+        int index = m_rowIndex.value(item, -1);
         if (index != -1) {
             beginRemoveRows(QModelIndex(), index, index);
-            m_appItems.removeAll(item);
+            removeItemAt(index);
             endRemoveRows();
 
             emit itemRemoved();
@@ -272,9 +380,47 @@ void ApplicationModel::updateGeometries(const QString &id, QRect rect)
     if (!item)
         return;
 
-    for (quint64 id : item->wids) {
-        m_iface->setIconGeometry(id, rect);
+    bool changed = false;
+
+    for (quint64 wid : item->wids) {
+        auto pending = m_pendingGeometries.find(wid);
+
+        if (pending != m_pendingGeometries.end()) {
+            changed |= pending.value() != rect;
+            pending.value() = rect;
+        } else if (m_iconGeometries.value(wid) != rect) {
+            m_pendingGeometries.insert(wid, rect);
+            changed = true;
+        }
     }
+
+    if (!changed)
+        return;
+
+    // Moving items report a new position every frame, wait for them
+    // to settle.
+    if (!m_geometryTimer->isActive())
+        m_pendingGeometriesSince.start();
+
+    if (m_pendingGeometriesSince.elapsed() < MaxGeometryDelay)
+        m_geometryTimer->start();
+}
+
+void ApplicationModel::flushIconGeometries()
+{
+    QHash<quint64, QRect> geometries;
+
+    for (auto it = m_pendingGeometries.constBegin(); it != m_pendingGeometries.constEnd(); ++it) {
+        if (m_widIndex.contains(it.key()) && m_iconGeometries.value(it.key()) != it.value()) {
+            m_iconGeometries.insert(it.key(), it.value());
+            geometries.insert(it.key(), it.value());
+        }
+    }
+
+    m_pendingGeometries.clear();
+
+    if (!geometries.isEmpty())
+        m_iface->setIconGeometries(geometries);
 }
 
 void ApplicationModel::move(int from, int to)
@@ -283,6 +429,7 @@ void ApplicationModel::move(int from, int to)
         return;
 
     m_appItems.move(from, to);
+    updateRows(qMin(from, to), qMax(from, to));
 
     if (from < to)
         beginMoveRows(QModelIndex(), from, from, QModelIndex(), to + 1);
@@ -294,54 +441,107 @@ void ApplicationModel::move(int from, int to)
 
 ApplicationItem *ApplicationModel::findItemByWId(quint64 wid)
 {
-    for (ApplicationItem *item : m_appItems) {
-        for (quint64 winId : item->wids) {
-            if (winId == wid)
-                return item;
-        }
-    }
-
-    return nullptr;
+    return m_widIndex.value(wid, nullptr);
 }
 
 ApplicationItem *ApplicationModel::findItemById(const QString &id)
 {
-    for (ApplicationItem *item : m_appItems) {
-        if (item->id == id)
-            return item;
-    }
-
-    return nullptr;
+    return firstInRowOrder(m_idIndex, m_rowIndex, id);
 }
 
 ApplicationItem *ApplicationModel::findItemByDesktop(const QString &desktop)
 {
-    for (ApplicationItem *item : m_appItems) {
-        if (item->desktopPath == desktop)
-            return item;
-    }
+    if (desktop.isEmpty())
+        return nullptr;
 
-    return nullptr;
+    return firstInRowOrder(m_desktopIndex, m_rowIndex, desktop);
 }
 
 bool ApplicationModel::contains(const QString &id)
 {
-    for (ApplicationItem *item : qAsConst(m_appItems)) {
-        if (item->id == id)
-            return true;
-    }
-
-    return false;
+    return m_idIndex.contains(id);
 }
 
 int ApplicationModel::indexOf(const QString &id)
 {
-    for (ApplicationItem *item : m_appItems) {
-        if (item->id == id)
-            return m_appItems.indexOf(item);
-    }
+    ApplicationItem *item = findItemById(id);
 
-    return -1;
+    if (!item)
+        return -1;
+
+    return m_rowIndex.value(item, -1);
+}
+
+void ApplicationModel::appendItem(ApplicationItem *item)
+{
+    m_appItems.append(item);
+    m_rowIndex.insert(item, m_appItems.size() - 1);
+    indexItem(item);
+}
+
+void ApplicationModel::removeItemAt(int row)
+{
+    ApplicationItem *item = m_appItems.takeAt(row);
+
+    if (!item->startupId.isEmpty())
+        m_launches.remove(item->startupId);
+
+    if (item == m_activeItem)
+        m_activeItem = nullptr;
+
+    unindexItem(item);
+    m_rowIndex.remove(item);
+    updateRows(row, m_appItems.size() - 1);
+
+    m_items.release(item);
+}
+
+void ApplicationModel::setItemId(ApplicationItem *item, const QString &id)
+{
+    m_idIndex.remove(item->id, item);
+    item->id = id;
+    m_idIndex.insert(item->id, item);
+}
+
+void ApplicationModel::addWindowToItem(ApplicationItem *item, quint64 wid)
+{
+    item->wids.append(wid);
+    m_widIndex.insert(wid, item);
+}
+
+void ApplicationModel::removeWindowFromItem(ApplicationItem *item, quint64 wid)
+{
+    item->wids.removeOne(wid);
+    m_widIndex.remove(wid);
+    m_iconGeometries.remove(wid);
+}
+
+void ApplicationModel::indexItem(ApplicationItem *item)
+{
+    for (quint64 wid : qAsConst(item->wids))
+        m_widIndex.insert(wid, item);
+
+    m_idIndex.insert(item->id, item);
+
+    if (!item->desktopPath.isEmpty())
+        m_desktopIndex.insert(item->desktopPath, item);
+}
+
+void ApplicationModel::unindexItem(ApplicationItem *item)
+{
+    for (quint64 wid : qAsConst(item->wids))
+        m_widIndex.remove(wid);
+
+    m_idIndex.remove(item->id, item);
+
+    if (!item->desktopPath.isEmpty())
+        m_desktopIndex.remove(item->desktopPath, item);
+}
+
+void ApplicationModel::updateRows(int from, int to)
+{
+    for (int i = from; i <= to; ++i)
+        m_rowIndex.insert(m_appItems.at(i), i);
 }
 
 void ApplicationModel::initPinnedApplications()
@@ -353,209 +553,472 @@ void ApplicationModel::initPinnedApplications()
     QStringList groups = set->childGroups();
 
     // Launcher
-    ApplicationItem *item = new ApplicationItem;
-    item->id = "lingmo-launcher";
-    item->exec = "lingmo-launcher";
-    item->iconName = "qrc:/images/rocket.svg";
-    item->visibleName = tr("Launcher");
-    item->fixed = true;
-    m_appItems.append(item);
+    ApplicationItem *launcher = m_items.acquire();
+    launcher->id = "lingmo-launcher";
+    launcher->exec = "lingmo-launcher";
+    launcher->iconName = "qrc:/images/rocket.svg";
+    launcher->visibleName = tr("Launcher");
+    launcher->fixed = true;
+
+    // Pinned Apps, read in one pass and ordered by their index.
+    QList<QPair<int, PinnedStore::Entry>> pinned;
+
+    for (const QString &id : groups) {
+        set->beginGroup(id);
+
+        PinnedStore::Entry entry;
+        entry.id = id;
+        entry.iconName = set->value("Icon").toString();
+        entry.visibleName = set->value("VisibleName").toString();
+        entry.exec = set->value("Exec").toString();
+        entry.desktopPath = set->value("DesktopPath").toString();
+        entry.argv = set->value("Argv").toStringList();
+        pinned.append({ set->value("Index").toInt(), entry });
+
+        set->endGroup();
+    }
 
-    // Pinned Apps
-    for (int i = 0; i < groups.size(); ++i) {
-        for (const QString &id : groups) {
-            set->beginGroup(id);
-            int index = set->value("Index").toInt();
-
-            if (index == i) {
-                beginInsertRows(QModelIndex(), rowCount(), rowCount());
-                ApplicationItem *item = new ApplicationItem;
-
-                item->desktopPath = set->value("DesktopPath").toString();
-                item->id = id;
-                item->isPinned = true;
-
-                if (!QFile(item->desktopPath).exists()) {
-                    set->endGroup();
-                    continue;
-                }
-
-                // Read from desktop file.
-                if (!item->desktopPath.isEmpty()) {
-                    QMap<QString, QString> desktopInfo = Utils::instance()->readInfoFromDesktop(item->desktopPath);
-                    item->iconName = desktopInfo.value("Icon");
-                    item->visibleName = desktopInfo.value("Name");
-                    item->exec = desktopInfo.value("Exec");
-                }
-
-                // Read from config file.
-                if (item->iconName.isEmpty())
-                    item->iconName = set->value("Icon").toString();
-
-                if (item->visibleName.isEmpty())
-                    item->visibleName = set->value("VisibleName").toString();
-
-                if (item->exec.isEmpty())
-                    item->exec = set->value("Exec").toString();
-
-                m_appItems.append(item);
-                endInsertRows();
-
-                emit itemAdded();
-                emit countChanged();
-
-                set->endGroup();
-                break;
-            } else {
-                set->endGroup();
-            }
+    std::stable_sort(pinned.begin(), pinned.end(), [] (const auto &a, const auto &b) {
+        return a.first < b.first;
+    });
+
+    QList<ApplicationItem *> items { launcher };
+
+    for (const auto &entry : qAsConst(pinned)) {
+        if (entry.second.desktopPath.isEmpty())
+            continue;
+
+        // Not installed (any more), kept until it shows up again. The
+        // applications folders are in memory already, only files kept
+        // elsewhere are looked up on disk.
+        const QString &desktopPath = entry.second.desktopPath;
+        const bool installed = m_sysAppMonitor->covers(desktopPath) ? m_sysAppMonitor->contains(desktopPath)
+                                                                    : QFile::exists(desktopPath);
+
+        if (!installed) {
+            m_unresolvedPinned.append(entry.second);
+            continue;
         }
+
+        items.append(createPinnedItem(entry.second));
     }
+
+    beginInsertRows(QModelIndex(), rowCount(), rowCount() + items.size() - 1);
+
+    for (ApplicationItem *item : qAsConst(items))
+        appendItem(item);
+
+    endInsertRows();
+
+    emit itemAdded();
+    emit countChanged();
+
+    // Nothing to write until the list changes.
+    m_pinnedStore.markClean();
+}
+
+ApplicationItem *ApplicationModel::createPinnedItem(const PinnedStore::Entry &entry)
+{
+    ApplicationItem *item = m_items.acquire();
+    item->id = entry.id;
+    item->desktopPath = entry.desktopPath;
+    item->isPinned = true;
+
+    // Read from desktop file.
+    readDesktopInfo(item, item->desktopPath);
+
+    // Read from config file.
+    if (item->iconName.isEmpty())
+        item->iconName = entry.iconName;
+
+    if (item->visibleName.isEmpty())
+        item->visibleName = entry.visibleName;
+
+    if (item->exec.isEmpty())
+        item->exec = entry.exec;
+
+    if (item->argv.isEmpty())
+        item->argv = entry.argv;
+
+    return item;
+}
+
+void ApplicationModel::onApplicationsChanged(const QStringList &added, const QStringList &removed, const QStringList &changed)
+{
+    Q_UNUSED(removed)
+
+    // Names and icons of pinned and running items follow their entries.
+    for (const QString &path : added + changed) {
+        ApplicationItem *item = findItemByDesktop(path);
+
+        if (item) {
+            readDesktopInfo(item, path);
+            handleDataChangedFromItem(item, { IconNameRole, VisibleNameRole });
+        }
+    }
+
+    QList<ApplicationItem *> items;
+
+    for (int i = m_unresolvedPinned.size() - 1; i >= 0; --i) {
+        const PinnedStore::Entry &entry = m_unresolvedPinned.at(i);
+
+        if (!added.contains(entry.desktopPath))
+            continue;
+
+        // Pinned again in the meantime.
+        if (!findItemByDesktop(entry.desktopPath))
+            items.prepend(createPinnedItem(entry));
+
+        m_unresolvedPinned.removeAt(i);
+    }
+
+    if (items.isEmpty())
+        return;
+
+    beginInsertRows(QModelIndex(), rowCount(), rowCount() + items.size() - 1);
+
+    for (ApplicationItem *item : qAsConst(items))
+        appendItem(item);
+
+    endInsertRows();
+
+    savePinAndUnPinList();
+
+    emit itemAdded();
+    emit countChanged();
 }
 
 void ApplicationModel::savePinAndUnPinList()
 {
-    QSettings settings(QSettings::UserScope, "lingmoos", "dock_pinned");
-    settings.clear();
+    m_pinnedStore.markDirty();
+}
 
-    int index = 0;
+QList<PinnedStore::Entry> ApplicationModel::pinnedEntries() const
+{
+    QList<PinnedStore::Entry> entries;
+    QSet<QString> ids;
 
     for (ApplicationItem *item : m_appItems) {
         if (item->isPinned) {
-            settings.beginGroup(item->id);
-            settings.setValue("Index", index);
-            settings.setValue("Icon", item->iconName);
-            settings.setValue("VisibleName", item->visibleName);
-            settings.setValue("Exec", item->exec);
-            settings.setValue("DesktopPath", item->desktopPath);
-            settings.endGroup();
-            ++index;
+            entries.append({ item->id, item->iconName, item->visibleName, item->exec, item->desktopPath, item->argv });
+            ids.insert(item->id);
         }
     }
 
-    settings.sync();
+    // Keep the pins of applications that are not installed right now.
+    for (const PinnedStore::Entry &entry : m_unresolvedPinned) {
+        if (!ids.contains(entry.id))
+            entries.append(entry);
+    }
+
+    return entries;
 }
 
-void ApplicationModel::handleDataChangedFromItem(ApplicationItem *item)
+void ApplicationModel::readDesktopInfo(ApplicationItem *item, const QString &desktopPath)
+{
+    SystemAppItem *app = m_sysAppMonitor->find(desktopPath);
+
+    if (!app)
+        return;
+
+    item->iconName = app->iconName;
+    item->visibleName = app->name;
+    item->exec = app->exec;
+    item->argv = app->argv;
+}
+
+// Pins written before argv was stored only know the exec line, which
+// has lost its quoting. Exec is tokenized again from the desktop file,
+// the exec line is the last resort.
+void ApplicationModel::resolveArgv(ApplicationItem *item)
+{
+    if (!item->argv.isEmpty())
+        return;
+
+    DesktopFileParser::Entry entry;
+
+    if (!item->desktopPath.isEmpty()
+            && DesktopFileParser(QLocale::system().name()).parse(item->desktopPath, &entry)
+            && !entry.exec.isEmpty()) {
+        item->argv = DesktopFileParser::expandExec(DesktopFileParser::tokenizeExec(entry.exec), QStringList(),
+                                                   entry.iconName, entry.name, item->desktopPath);
+    } else if (!item->exec.isEmpty()) {
+        item->argv = DesktopFileParser::expandExec(DesktopFileParser::tokenizeExec(item->exec));
+    }
+}
+
+void ApplicationModel::handleDataChangedFromItem(ApplicationItem *item, const QVector<int> &roles)
 {
     if (!item)
         return;
 
-    QModelIndex idx = index(indexOf(item->id), 0, QModelIndex());
+    QModelIndex idx = index(m_rowIndex.value(item, -1), 0, QModelIndex());
 
     if (idx.isValid()) {
-        emit dataChanged(idx, idx);
+        emit dataChanged(idx, idx, roles);
     }
 }
 
 void ApplicationModel::onWindowAdded(quint64 wid)
 {
+    m_windowEvents.append({ WindowEvent::Added, wid });
+
+    if (!m_flushTimer->isActive())
+        m_flushTimer->start();
+}
+
+void ApplicationModel::onWindowsAdded(const QList<quint64> &wids)
+{
+    for (quint64 wid : wids)
+        m_windowEvents.append({ WindowEvent::Added, wid });
+
+    if (!m_flushTimer->isActive())
+        m_flushTimer->start();
+}
+
+void ApplicationModel::onWindowRemoved(quint64 wid)
+{
+    // Short-lived windows never make it into the model.
+    for (int i = m_windowEvents.size() - 1; i >= 0; --i) {
+        if (m_windowEvents.at(i).wid == wid) {
+            if (m_windowEvents.at(i).type == WindowEvent::Added) {
+                m_windowEvents.removeAt(i);
+
+                if (!m_widIndex.contains(wid))
+                    return;
+            }
+
+            break;
+        }
+    }
+
+    m_windowEvents.append({ WindowEvent::Removed, wid });
+
+    if (!m_flushTimer->isActive())
+        m_flushTimer->start();
+}
+
+void ApplicationModel::onActiveChanged(quint64 wid)
+{
+    // Only the last one of the frame matters.
+    m_activeWindow = wid;
+    m_activeChanged = true;
+
+    if (!m_flushTimer->isActive())
+        m_flushTimer->start();
+}
+
+void ApplicationModel::flushWindowEvents()
+{
+    const QList<WindowEvent> events = m_windowEvents;
+    bool inserted = false;
+    bool removed = false;
+    QElapsedTimer timer;
+
+    timer.start();
+
+    m_windowEvents.clear();
+
+    for (const WindowEvent &event : events) {
+        if (event.type == WindowEvent::Added)
+            inserted |= insertWindow(event.wid);
+        else
+            removed |= removeWindow(event.wid);
+    }
+
+    if (m_activeChanged) {
+        m_activeChanged = false;
+        updateActive(m_activeWindow);
+    }
+
+    if (inserted)
+        emit itemAdded();
+    if (removed)
+        emit itemRemoved();
+
+    // Once for the whole frame, every countChanged resizes the dock
+    // and updates its struts.
+    if (inserted || removed)
+        emit countChanged();
+
+    emit windowEventsFlushed(events.size(), timer.nsecsElapsed());
+}
+
+bool ApplicationModel::insertWindow(quint64 wid)
+{
+    // Mapped while the initial batch was being fetched.
+    if (m_widIndex.contains(wid))
+        return false;
+
     QMap<QString, QVariant> info = m_iface->requestInfo(wid);
     const QString id = info.value("id").toString();
+    bool inserted = false;
 
     // Skip...
     if (id == "lingmo-launcher")
-        return;
+        return false;
 
     QString desktopPath = m_iface->desktopFilePath(wid);
     ApplicationItem *desktopItem = findItemByDesktop(desktopPath);
 
+    const bool active = info.value("active").toBool();
+
     // Use desktop find
     if (!desktopPath.isEmpty() && desktopItem != nullptr) {
-        desktopItem->wids.append(wid);
-        // Need to update application active status.
-        desktopItem->isActive = info.value("active").toBool();
+        QVector<int> roles { WindowCountRole };
+
+        addWindowToItem(desktopItem, wid);
 
         if (desktopItem->id != id) {
-            desktopItem->id = id;
+            setItemId(desktopItem, id);
             savePinAndUnPinList();
+            roles << AppIdRole;
         }
 
-        handleDataChangedFromItem(desktopItem);
+        handleDataChangedFromItem(desktopItem, roles);
+
+        // Need to update application active status.
+        if (active)
+            setActiveItem(desktopItem);
     }
     // Find from id
     else if (contains(id)) {
-        for (ApplicationItem *item : m_appItems) {
-            if (item->id == id) {
-                item->wids.append(wid);
-                // Need to update application active status.
-                item->isActive = info.value("active").toBool();
-                handleDataChangedFromItem(item);
-            }
-        }
+        ApplicationItem *item = findItemById(id);
+        addWindowToItem(item, wid);
+        handleDataChangedFromItem(item, { WindowCountRole });
+
+        if (active)
+            setActiveItem(item);
     }
     // New item needs to be added.
     else {
         beginInsertRows(QModelIndex(), rowCount(), rowCount());
-        ApplicationItem *item = new ApplicationItem;
+        ApplicationItem *item = m_items.acquire();
         item->id = id;
         item->iconName = info.value("iconName").toString();
         item->visibleName = info.value("visibleName").toString();
-        item->isActive = info.value("active").toBool();
         item->wids.append(wid);
 
         if (!desktopPath.isEmpty()) {
-            QMap<QString, QString> desktopInfo = Utils::instance()->readInfoFromDesktop(desktopPath);
-            item->iconName = desktopInfo.value("Icon");
-            item->visibleName = desktopInfo.value("Name");
-            item->exec = desktopInfo.value("Exec");
+            readDesktopInfo(item, desktopPath);
             item->desktopPath = desktopPath;
         }
 
-        m_appItems << item;
+        appendItem(item);
         endInsertRows();
 
-        emit itemAdded();
-        emit countChanged();
+        if (active)
+            setActiveItem(item);
+
+        inserted = true;
+    }
+
+    // First window of a pending launch, by startup id or by item.
+    if (!m_launches.isEmpty()) {
+        QByteArray startupId = m_iface->startupId(wid);
+
+        if (!m_launches.contains(startupId)) {
+            ApplicationItem *item = findItemByWId(wid);
+            startupId = item ? item->startupId : QByteArray();
+        }
+
+        finishLaunch(startupId, true);
     }
+
+    return inserted;
 }
 
-void ApplicationModel::onWindowRemoved(quint64 wid)
+void ApplicationModel::finishLaunch(const QByteArray &startupId, bool ok)
 {
-    ApplicationItem *item = findItemByWId(wid);
+    ApplicationItem *item = m_launches.take(startupId);
 
     if (!item)
         return;
 
+    const qint64 latency = item->launchTimer.elapsed();
+    item->startupId.clear();
+
+    // Clears the busy cursor of programs that do not do it themselves.
+    m_iface->sendStartupFinished(startupId);
+
+    // Window classes replace the id, the desktop file name stays.
+    const QString key = item->desktopPath.isEmpty() ? item->id : QFileInfo(item->desktopPath).completeBaseName();
+    LaunchStats &stats = m_launchStats[key];
+    ++stats.count;
+
+    if (ok) {
+        stats.last = latency;
+        stats.total += latency;
+        stats.max = qMax(stats.max, latency);
+    } else {
+        ++stats.failures;
+    }
+
+    handleDataChangedFromItem(item, { LaunchingRole });
+}
+
+void ApplicationModel::onLaunchFinished(const QString &appId, bool ok)
+{
+    ApplicationItem *item = findItemById(appId);
+
+    if (!ok && item && !item->startupId.isEmpty())
+        finishLaunch(item->startupId, false);
+}
+
+bool ApplicationModel::removeWindow(quint64 wid)
+{
+    ApplicationItem *item = findItemByWId(wid);
+
+    if (!item)
+        return false;
+
     // Remove from wid list.
-    item->wids.removeOne(wid);
+    removeWindowFromItem(item, wid);
 
     if (item->currentActive >= item->wids.size())
         item->currentActive = 0;
 
-    handleDataChangedFromItem(item);
+    handleDataChangedFromItem(item, { WindowCountRole });
 
     if (item->wids.isEmpty()) {
         // If it is not fixed to the dock, need to remove it.
         if (!item->isPinned) {
-            int index = indexOf(item->id);
+            int index = m_rowIndex.value(item, -1);
 
             if (index == -1)
-                return;
+                return false;
 
             beginRemoveRows(QModelIndex(), index, index);
-            m_appItems.removeAll(item);
+            removeItemAt(index);
             endRemoveRows();
 
-            emit itemRemoved();
-            emit countChanged();
+            return true;
         }
     }
+
+    return false;
 }
 
-void ApplicationModel::onActiveChanged(quint64 wid)
+void ApplicationModel::updateActive(quint64 wid)
 {
-    // Using this method will cause the listview scrollbar to reset.
-    // beginResetModel();
+    setActiveItem(m_widIndex.value(wid, nullptr));
+}
 
-    for (ApplicationItem *item : m_appItems) {
-        if (item->isActive != item->wids.contains(wid)) {
-            item->isActive = item->wids.contains(wid);
+// Only the previous and the new active item change.
+void ApplicationModel::setActiveItem(ApplicationItem *item)
+{
+    if (item == m_activeItem)
+        return;
 
-            QModelIndex idx = index(indexOf(item->id), 0, QModelIndex());
-            if (idx.isValid()) {
-                emit dataChanged(idx, idx);
-            }
-        }
+    if (m_activeItem) {
+        m_activeItem->isActive = false;
+        handleDataChangedFromItem(m_activeItem, { ActiveRole });
+    }
+
+    m_activeItem = item;
+
+    if (item) {
+        item->isActive = true;
+        handleDataChangedFromItem(item, { ActiveRole });
     }
 }
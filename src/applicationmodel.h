@@ -21,9 +21,12 @@
 #define APPLICATIONMODEL_H
 
 #include <QAbstractListModel>
+#include <QTimer>
 #include "applicationitem.h"
+#include "applicationitempool.h"
+#include "pinnedstore.h"
 #include "systemappmonitor.h"
-#include "xwindowinterface.h"
+#include "windowbackend.h"
 
 class ApplicationModel : public QAbstractListModel
 {
@@ -38,7 +41,8 @@ public:
         WindowCountRole,
         IsPinnedRole,
         DesktopFileRole,
-        FixedItemRole
+        FixedItemRole,
+        LaunchingRole
     };
 
     explicit ApplicationModel(QObject *parent = nullptr);
@@ -58,6 +62,7 @@ public:
     Q_INVOKABLE void raiseWindow(const QString &id);
 
     Q_INVOKABLE bool openNewInstance(const QString &appId);
+    Q_INVOKABLE void preWarm(const QString &appId);
     Q_INVOKABLE void closeAllByAppId(const QString &appId);
     Q_INVOKABLE void pin(const QString &appId);
     Q_INVOKABLE void unPin(const QString &appId);
@@ -66,12 +71,28 @@ public:
 
     Q_INVOKABLE void move(int from, int to);
 
+    // Click to first window per application: count, failures, last,
+    // average and max in milliseconds.
+    Q_INVOKABLE QVariantMap launchMetrics() const;
+    // Items in use and item slots allocated.
+    Q_INVOKABLE QVariantMap itemStats() const;
+
+    // Applies the window events queued so far right away, instead of
+    // on the next frame.
+    void flushWindowEvents();
+
 signals:
     void countChanged();
 
     void itemAdded();
     void itemRemoved();
 
+    // After each batch of window events, with the time spent applying it.
+    void windowEventsFlushed(int events, qint64 nsecs);
+
+    // Latency is measured from the click to the launcher's answer.
+    void launchFinished(const QString &appId, bool ok, qint64 latency);
+
 private:
     ApplicationItem *findItemByWId(quint64 wid);
     ApplicationItem *findItemById(const QString &id);
@@ -79,19 +100,100 @@ private:
 
     bool contains(const QString &id);
     int indexOf(const QString &id);
+
+    void appendItem(ApplicationItem *item);
+    void removeItemAt(int row);
+    void setItemId(ApplicationItem *item, const QString &id);
+    void addWindowToItem(ApplicationItem *item, quint64 wid);
+    void removeWindowFromItem(ApplicationItem *item, quint64 wid);
+    void indexItem(ApplicationItem *item);
+    void unindexItem(ApplicationItem *item);
+    void updateRows(int from, int to);
+
     void initPinnedApplications();
     void savePinAndUnPinList();
+    QList<PinnedStore::Entry> pinnedEntries() const;
+    ApplicationItem *createPinnedItem(const PinnedStore::Entry &entry);
+    void onApplicationsChanged(const QStringList &added, const QStringList &removed, const QStringList &changed);
+
+    void readDesktopInfo(ApplicationItem *item, const QString &desktopPath);
+    void resolveArgv(ApplicationItem *item);
+    void handleDataChangedFromItem(ApplicationItem *item, const QVector<int> &roles = QVector<int>());
 
-    void handleDataChangedFromItem(ApplicationItem *item);
+    bool insertWindow(quint64 wid);
+    bool removeWindow(quint64 wid);
+    void updateActive(quint64 wid);
+    void setActiveItem(ApplicationItem *item);
+    void flushIconGeometries();
 
     void onWindowAdded(quint64 wid);
+    void onWindowsAdded(const QList<quint64> &wids);
     void onWindowRemoved(quint64 wid);
     void onActiveChanged(quint64 wid);
 
+    void finishLaunch(const QByteArray &startupId, bool ok);
+    void onLaunchFinished(const QString &appId, bool ok);
+
 private:
-    XWindowInterface *m_iface;
+    struct WindowEvent
+    {
+        enum Type {
+            Added,
+            Removed
+        };
+
+        Type type;
+        quint64 wid;
+    };
+
+    struct LaunchStats
+    {
+        int count = 0;
+        int failures = 0;
+        qint64 last = 0;
+        qint64 total = 0;
+        qint64 max = 0;
+    };
+
+    WindowBackend *m_iface;
     SystemAppMonitor *m_sysAppMonitor;
+    // Owns the items, m_appItems and the indexes below only point into it.
+    ApplicationItemPool m_items;
     QList<ApplicationItem *> m_appItems;
+
+    // Lookup tables kept in sync with m_appItems, so that window
+    // events do not have to scan every item (and every window).
+    QHash<quint64, ApplicationItem *> m_widIndex;
+    QMultiHash<QString, ApplicationItem *> m_idIndex;
+    QMultiHash<QString, ApplicationItem *> m_desktopIndex;
+    QHash<ApplicationItem *, int> m_rowIndex;
+
+    // The only item with isActive set, if any.
+    ApplicationItem *m_activeItem;
+
+    // Window events of the current frame, applied together by
+    // m_flushTimer so that a burst of windows relayouts the dock once.
+    QList<WindowEvent> m_windowEvents;
+    quint64 m_activeWindow;
+    bool m_activeChanged;
+    QTimer *m_flushTimer;
+
+    // Icon geometries, published once the dock stops moving its items.
+    QHash<quint64, QRect> m_iconGeometries;
+    QHash<quint64, QRect> m_pendingGeometries;
+    QElapsedTimer m_pendingGeometriesSince;
+    QTimer *m_geometryTimer;
+
+    // Pending launches by startup id.
+    QHash<QByteArray, ApplicationItem *> m_launches;
+    QHash<QString, LaunchStats> m_launchStats;
+
+    // Pinned entries whose desktop file is missing, not in the model.
+    QList<PinnedStore::Entry> m_unresolvedPinned;
+
+    // Last, it reads the items when it writes pending changes on
+    // destruction.
+    PinnedStore m_pinnedStore;
 };
 
 #endif // APPLICATIONMODEL_H
@@ -0,0 +1,423 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "desktopfileparser.h"
+
+#include <QFile>
+#include <cstring>
+
+// Rank of keys without a [locale] suffix, localized keys rank from 0 up.
+static const int UnlocalizedRank = 100;
+
+static inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static inline bool toBool(const char *data, qsizetype size)
+{
+    const QByteArrayView value(data, size);
+    return value == "true" || value == "1";
+}
+
+DesktopFileParser::DesktopFileParser(const QString &locale)
+{
+    // lang_COUNTRY.ENCODING@MODIFIER, the encoding is not used for matching.
+    QByteArray name = locale.toLatin1();
+    QByteArray modifier;
+
+    const int at = name.indexOf('@');
+    if (at != -1) {
+        modifier = name.mid(at + 1);
+        name.truncate(at);
+    }
+
+    const int dot = name.indexOf('.');
+    if (dot != -1)
+        name.truncate(dot);
+
+    const int underscore = name.indexOf('_');
+    const QByteArray lang = underscore != -1 ? name.left(underscore) : name;
+
+    if (underscore != -1 && !modifier.isEmpty())
+        m_locales.append(name + '@' + modifier);
+
+    if (underscore != -1)
+        m_locales.append(name);
+
+    if (!lang.isEmpty() && !modifier.isEmpty())
+        m_locales.append(lang + '@' + modifier);
+
+    if (!lang.isEmpty())
+        m_locales.append(lang);
+}
+
+bool DesktopFileParser::parse(const QString &filePath, Entry *entry) const
+{
+    QFile file(filePath);
+
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    const qint64 size = file.size();
+
+    // Map the file when possible, otherwise fall back to a single read.
+    if (size > 0) {
+        if (uchar *data = file.map(0, size)) {
+            const bool ok = parse(reinterpret_cast<const char *>(data), size, entry);
+            file.unmap(data);
+            return ok;
+        }
+    }
+
+    const QByteArray data = file.readAll();
+    return parse(data.constData(), data.size(), entry);
+}
+
+bool DesktopFileParser::parse(const char *data, qsizetype size, Entry *entry) const
+{
+    int nameRank = UnlocalizedRank + 1;
+    int genericNameRank = UnlocalizedRank + 1;
+    int commentRank = UnlocalizedRank + 1;
+
+    bool inGroup = false;
+    bool found = false;
+
+    const char *pos = data;
+    const char *end = data + size;
+
+    while (pos < end) {
+        const char *lineEnd = static_cast<const char *>(std::memchr(pos, '\n', end - pos));
+
+        if (!lineEnd)
+            lineEnd = end;
+
+        const char *begin = pos;
+        const char *stop = lineEnd;
+        pos = lineEnd + 1;
+
+        while (begin < stop && isBlank(*begin))
+            ++begin;
+
+        while (stop > begin && (isBlank(stop[-1]) || stop[-1] == '\r'))
+            --stop;
+
+        if (begin == stop || *begin == '#')
+            continue;
+
+        if (*begin == '[') {
+            // [Desktop Entry] comes first, any other group ends the scan.
+            if (inGroup)
+                break;
+
+            inGroup = QByteArrayView(begin, stop - begin) == "[Desktop Entry]";
+            found = found || inGroup;
+            continue;
+        }
+
+        if (!inGroup)
+            continue;
+
+        const char *equal = static_cast<const char *>(std::memchr(begin, '=', stop - begin));
+
+        if (!equal)
+            continue;
+
+        const char *keyEnd = equal;
+        while (keyEnd > begin && isBlank(keyEnd[-1]))
+            --keyEnd;
+
+        const char *value = equal + 1;
+        while (value < stop && isBlank(*value))
+            ++value;
+
+        const qsizetype valueSize = stop - value;
+
+        // Key[locale]
+        int rank = UnlocalizedRank;
+
+        if (keyEnd > begin && keyEnd[-1] == ']') {
+            const char *bracket = static_cast<const char *>(std::memchr(begin, '[', keyEnd - begin));
+
+            if (!bracket)
+                continue;
+
+            rank = localeRank(bracket + 1, keyEnd - bracket - 2);
+
+            // Some other language.
+            if (rank == -1)
+                continue;
+
+            keyEnd = bracket;
+        }
+
+        const QByteArrayView key(begin, keyEnd - begin);
+
+        if (key == "Name") {
+            if (rank < nameRank) {
+                nameRank = rank;
+                entry->name = unescape(value, valueSize);
+            }
+        } else if (key == "GenericName") {
+            if (rank < genericNameRank) {
+                genericNameRank = rank;
+                entry->genericName = unescape(value, valueSize);
+            }
+        } else if (key == "Comment") {
+            if (rank < commentRank) {
+                commentRank = rank;
+                entry->comment = unescape(value, valueSize);
+            }
+        } else if (rank != UnlocalizedRank) {
+            continue;
+        } else if (key == "Icon") {
+            entry->iconName = unescape(value, valueSize);
+        } else if (key == "Exec") {
+            entry->exec = unescape(value, valueSize);
+        } else if (key == "StartupWMClass") {
+            entry->startupWMClass = unescape(value, valueSize);
+        } else if (key == "OnlyShowIn") {
+            entry->onlyShowIn = unescapeList(value, valueSize);
+        } else if (key == "Terminal") {
+            entry->terminal = toBool(value, valueSize);
+        } else if (key == "NoDisplay") {
+            entry->noDisplay = toBool(value, valueSize);
+        } else if (key == "Hidden") {
+            entry->hidden = toBool(value, valueSize);
+        }
+    }
+
+    return found;
+}
+
+QString DesktopFileParser::unescape(const char *data, qsizetype size)
+{
+    if (size == 0 || !std::memchr(data, '\\', size))
+        return QString::fromUtf8(data, size);
+
+    QByteArray result;
+    result.reserve(size);
+
+    for (qsizetype i = 0; i < size; ++i) {
+        char c = data[i];
+
+        if (c == '\\' && i + 1 < size) {
+            switch (data[++i]) {
+            case 's': c = ' '; break;
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 'r': c = '\r'; break;
+            case '\\': c = '\\'; break;
+            default:
+                // Not ours, e.g. the quoting rules of Exec.
+                result.append('\\');
+                c = data[i];
+                break;
+            }
+        }
+
+        result.append(c);
+    }
+
+    return QString::fromUtf8(result);
+}
+
+QStringList DesktopFileParser::unescapeList(const char *data, qsizetype size)
+{
+    QStringList result;
+    qsizetype start = 0;
+
+    for (qsizetype i = 0; i < size; ++i) {
+        if (data[i] == '\\') {
+            ++i;
+        } else if (data[i] == ';') {
+            result.append(unescape(data + start, i - start).replace("\\;", ";"));
+            start = i + 1;
+        }
+    }
+
+    if (start < size)
+        result.append(unescape(data + start, size - start).replace("\\;", ";"));
+
+    return result;
+}
+
+QString DesktopFileParser::stripFieldCodes(const QString &exec)
+{
+    QString result;
+    result.reserve(exec.size());
+
+    for (qsizetype i = 0; i < exec.size(); ++i) {
+        // %f, %U, %% and friends.
+        if (exec.at(i) == '%' && i + 1 < exec.size()) {
+            ++i;
+            continue;
+        }
+
+        result.append(exec.at(i));
+    }
+
+    if (result.startsWith('"'))
+        result.remove(0, 1);
+
+    return result.simplified();
+}
+
+QStringList DesktopFileParser::tokenizeExec(const QString &exec)
+{
+    QStringList tokens;
+    QString token;
+    bool inToken = false;
+    bool quoted = false;
+
+    for (qsizetype i = 0; i < exec.size(); ++i) {
+        const QChar c = exec.at(i);
+
+        if (quoted) {
+            // Only these may be escaped inside quotes.
+            if (c == '"') {
+                quoted = false;
+            } else if (c == '\\' && i + 1 < exec.size() && QStringLiteral("\"`$\\").contains(exec.at(i + 1))) {
+                token.append(exec.at(++i));
+            } else {
+                token.append(c);
+            }
+        } else if (c == '"') {
+            quoted = true;
+            inToken = true;
+        } else if (c == ' ' || c == '\t' || c == '\n') {
+            if (inToken) {
+                tokens.append(token);
+                token.clear();
+                inToken = false;
+            }
+        } else if (c == '\\' && i + 1 < exec.size()) {
+            token.append(exec.at(++i));
+            inToken = true;
+        } else {
+            token.append(c);
+            inToken = true;
+        }
+    }
+
+    if (inToken)
+        tokens.append(token);
+
+    return tokens;
+}
+
+QStringList DesktopFileParser::expandExec(const QStringList &tokens, const QStringList &files,
+                                          const QString &iconName, const QString &name,
+                                          const QString &desktopPath)
+{
+    QStringList argv;
+    argv.reserve(tokens.size() + files.size());
+
+    for (const QString &token : tokens) {
+        if (token.size() == 2 && token.at(0) == '%') {
+            switch (token.at(1).unicode()) {
+            case 'f':
+            case 'u':
+                if (!files.isEmpty())
+                    argv.append(files.first());
+                break;
+            case 'F':
+            case 'U':
+                argv.append(files);
+                break;
+            case 'i':
+                if (!iconName.isEmpty())
+                    argv << "--icon" << iconName;
+                break;
+            case 'c':
+                if (!name.isEmpty())
+                    argv.append(name);
+                break;
+            case 'k':
+                if (!desktopPath.isEmpty())
+                    argv.append(desktopPath);
+                break;
+            case '%':
+                argv.append("%");
+                break;
+            default:
+                // Deprecated codes, %d, %D, %n, %N, %v and %m.
+                break;
+            }
+
+            continue;
+        }
+
+        if (!token.contains('%')) {
+            argv.append(token);
+            continue;
+        }
+
+        // Inside an argument only %% is meaningful.
+        QString arg;
+        arg.reserve(token.size());
+
+        for (qsizetype i = 0; i < token.size(); ++i) {
+            if (token.at(i) == '%' && i + 1 < token.size()) {
+                if (token.at(++i) == '%')
+                    arg.append('%');
+                continue;
+            }
+
+            arg.append(token.at(i));
+        }
+
+        argv.append(arg);
+    }
+
+    return argv;
+}
+
+int DesktopFileParser::programIndex(const QStringList &argv)
+{
+    if (argv.isEmpty() || (argv.first() != "env" && !argv.first().endsWith("/env")))
+        return 0;
+
+    int i = 1;
+
+    while (i < argv.size()) {
+        const QString &arg = argv.at(i);
+
+        if (arg == "-u" || arg == "--unset")
+            i += 2;
+        else if (arg.contains('=') || arg.startsWith('-'))
+            ++i;
+        else
+            break;
+    }
+
+    return i < argv.size() ? i : 0;
+}
+
+int DesktopFileParser::localeRank(const char *data, qsizetype size) const
+{
+    const QByteArrayView locale(data, size);
+
+    for (int i = 0; i < m_locales.size(); ++i) {
+        if (locale == QByteArrayView(m_locales.at(i)))
+            return i;
+    }
+
+    return -1;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DESKTOPFILEPARSER_H
+#define DESKTOPFILEPARSER_H
+
+#include <QByteArray>
+#include <QStringList>
+
+// Minimal .desktop file reader, it only looks at the [Desktop Entry]
+// group and only decodes the keys used by the dock.
+// ref: https://specifications.freedesktop.org/desktop-entry-spec/latest/
+class DesktopFileParser
+{
+public:
+    struct Entry {
+        QString name;
+        QString genericName;
+        QString comment;
+        QString iconName;
+        QString exec;
+        QString startupWMClass;
+        QStringList onlyShowIn;
+        bool terminal = false;
+        bool noDisplay = false;
+        bool hidden = false;
+    };
+
+    explicit DesktopFileParser(const QString &locale);
+
+    bool parse(const QString &filePath, Entry *entry) const;
+    bool parse(const char *data, qsizetype size, Entry *entry) const;
+
+    static QString unescape(const char *data, qsizetype size);
+    static QStringList unescapeList(const char *data, qsizetype size);
+    static QString stripFieldCodes(const QString &exec);
+
+    // Exec value split into arguments, with quoting and escapes resolved.
+    // Field codes are kept as they are until expandExec().
+    static QStringList tokenizeExec(const QString &exec);
+    static QStringList expandExec(const QStringList &tokens,
+                                  const QStringList &files = QStringList(),
+                                  const QString &iconName = QString(),
+                                  const QString &name = QString(),
+                                  const QString &desktopPath = QString());
+    // Index of the program itself, skipping an "env VAR=value" prefix.
+    static int programIndex(const QStringList &argv);
+
+private:
+    int localeRank(const char *data, qsizetype size) const;
+
+private:
+    // From the most to the least specific:
+    // lang_COUNTRY@MODIFIER, lang_COUNTRY, lang@MODIFIER, lang
+    QList<QByteArray> m_locales;
+};
+
+#endif // DESKTOPFILEPARSER_H
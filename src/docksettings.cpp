@@ -41,6 +41,7 @@ DockSettings::DockSettings(QObject *parent)
     , m_iconSize(0)
     , m_edgeMargins(0)
     , m_roundedWindowEnabled(true)
+    , m_preWarmEnabled(false)
     , m_direction(Left)
     , m_visibility(AlwaysShow)
     , m_settings(new QSettings(QSettings::UserScope, "lingmoos", "dock"))
@@ -57,6 +58,8 @@ DockSettings::DockSettings(QObject *parent)
         m_settings->setValue("Style", Round);
     if (!m_settings->contains("EdgeMargins"))
         m_settings->setValue("EdgeMargins", 10);
+    if (!m_settings->contains("PreWarm"))
+        m_settings->setValue("PreWarm", false);
 
     m_settings->sync();
 
@@ -66,6 +69,7 @@ DockSettings::DockSettings(QObject *parent)
     m_roundedWindowEnabled = m_settings->value("RoundedWindow").toBool();
     m_style = static_cast<Style>(m_settings->value("Style").toInt());
     m_edgeMargins = m_settings->value("EdgeMargins").toInt();
+    m_preWarmEnabled = m_settings->value("PreWarm").toBool();
 }
 
 int DockSettings::iconSize() const
@@ -146,3 +150,17 @@ void DockSettings::setStyle(const DockSettings::Style &style)
         emit styleChanged();
     }
 }
+
+bool DockSettings::preWarmEnabled() const
+{
+    return m_preWarmEnabled;
+}
+
+void DockSettings::setPreWarmEnabled(bool enabled)
+{
+    if (m_preWarmEnabled != enabled) {
+        m_preWarmEnabled = enabled;
+        m_settings->setValue("PreWarm", enabled);
+        emit preWarmEnabledChanged();
+    }
+}
@@ -31,6 +31,7 @@ class DockSettings : public QObject
     Q_PROPERTY(int edgeMargins READ edgeMargins WRITE setEdgeMargins)
     Q_PROPERTY(bool roundedWindowEnabled READ roundedWindowEnabled WRITE setRoundedWindowEnabled NOTIFY roundedWindowEnabledChanged)
     Q_PROPERTY(Style style READ style WRITE setStyle NOTIFY styleChanged)
+    Q_PROPERTY(bool preWarmEnabled READ preWarmEnabled WRITE setPreWarmEnabled NOTIFY preWarmEnabledChanged)
 
 public:
     enum Direction {
@@ -75,17 +76,22 @@ public:
     Style style() const;
     void setStyle(const Style &style);
 
+    bool preWarmEnabled() const;
+    void setPreWarmEnabled(bool enabled);
+
 signals:
     void iconSizeChanged();
     void directionChanged();
     void visibilityChanged();
     void roundedWindowEnabledChanged();
     void styleChanged();
+    void preWarmEnabledChanged();
 
 private:
     int m_iconSize;
     int m_edgeMargins;
     bool m_roundedWindowEnabled;
+    bool m_preWarmEnabled;
     Direction m_direction;
     Visibility m_visibility;
     Style m_style;
@@ -19,6 +19,7 @@
 
 #include "mainwindow.h"
 #include "processprovider.h"
+#include "windowbackend.h"
 #include "dockadaptor.h"
 
 #include <QGuiApplication>
@@ -45,9 +46,18 @@ MainWindow::MainWindow(QQuickView *parent)
     , m_hideBlocked(false)
     , m_showTimer(new QTimer(this))
     , m_hideTimer(new QTimer(this))
+    , m_geometryTimer(new QTimer(this))
+    , m_strutApplied(false)
+    , m_geometryWrites(0)
+    , m_strutWrites(0)
+    , m_suppressedWrites(0)
 {
     new DockAdaptor(this);
 
+    m_geometryTimer->setSingleShot(true);
+    m_geometryTimer->setInterval(0);
+    connect(m_geometryTimer, &QTimer::timeout, this, &MainWindow::applyGeometry);
+
     installEventFilter(this);
 
     setDefaultAlphaBuffer(false);
@@ -58,7 +68,7 @@ MainWindow::MainWindow(QQuickView *parent)
     KX11Extras::setType(winId(), NET::Dock);
 
     engine()->rootContext()->setContextProperty("appModel", m_appModel);
-    engine()->rootContext()->setContextProperty("process", new ProcessProvider);
+    engine()->rootContext()->setContextProperty("process", ProcessProvider::self());
     engine()->rootContext()->setContextProperty("Settings", m_settings);
     engine()->rootContext()->setContextProperty("mainWindow", this);
     engine()->rootContext()->setContextProperty("trash", m_trashManager);
@@ -69,7 +79,8 @@ MainWindow::MainWindow(QQuickView *parent)
     initScreens();
 
     initSlideWindow();
-    resizeWindow();
+    // Right away, the window must not be shown with its default size.
+    applyGeometry();
     onVisibilityChanged();
 
     m_showTimer->setSingleShot(true);
@@ -115,6 +126,30 @@ bool MainWindow::pinned(const QString &desktop)
     return m_appModel->isDesktopPinned(desktop);
 }
 
+QVariantMap MainWindow::launchMetrics() const
+{
+    return m_appModel->launchMetrics();
+}
+
+QVariantMap MainWindow::itemStats() const
+{
+    return m_appModel->itemStats();
+}
+
+QVariantMap MainWindow::windowCacheStats() const
+{
+    return WindowBackend::self()->cacheStats();
+}
+
+QVariantMap MainWindow::geometryStats() const
+{
+    QVariantMap stats;
+    stats.insert("geometryWrites", m_geometryWrites);
+    stats.insert("strutWrites", m_strutWrites);
+    stats.insert("suppressedWrites", m_suppressedWrites);
+    return stats;
+}
+
 QRect MainWindow::primaryGeometry() const
 {
     return geometry();
@@ -160,18 +195,19 @@ void MainWindow::updateSize()
     resizeWindow();
 }
 
+bool MainWindow::compositing() const
+{
+    QQuickItem *item = qobject_cast<QQuickItem *>(rootObject());
+    return item && item->property("compositing").toBool();
+}
+
 QRect MainWindow::windowRect() const
 {
     const QRect screenGeometry = screen()->geometry();
     const QRect availableGeometry = screen()->availableGeometry();
 
     bool isHorizontal = m_settings->direction() == DockSettings::Bottom;
-    bool compositing = false;
-    QQuickItem *item = qobject_cast<QQuickItem *>(rootObject());
-
-    if (item) {
-        compositing = item->property("compositing").toBool();
-    }
+    bool compositing = this->compositing();
 
     QSize newSize(0, 0);
     QPoint position(0, 0);
@@ -246,7 +282,24 @@ QRect MainWindow::windowRect() const
 
 void MainWindow::resizeWindow()
 {
-    setGeometry(windowRect());
+    m_geometryTimer->start();
+}
+
+void MainWindow::applyGeometry()
+{
+    m_geometryTimer->stop();
+
+    const QRect rect = windowRect();
+
+    // The window manager may have moved us meanwhile.
+    if (rect != m_appliedRect || rect != geometry()) {
+        setGeometry(rect);
+        m_appliedRect = rect;
+        ++m_geometryWrites;
+    } else {
+        ++m_suppressedWrites;
+    }
+
     updateViewStruts();
 
     emit resizingFished();
@@ -290,17 +343,31 @@ void MainWindow::initSlideWindow()
     KWindowEffects::slideWindow(fromWinId(winId()), location);
 }
 
-void MainWindow::updateViewStruts()
+bool MainWindow::ViewStrut::operator==(const ViewStrut &other) const
 {
-    bool compositing = false;
-    QQuickItem *item = qobject_cast<QQuickItem *>(rootObject());
-
-    if (item) {
-        compositing = item->property("compositing").toBool();
-    }
+    if (!enabled || !other.enabled)
+        return enabled == other.enabled;
+
+    return direction == other.direction
+            && style == other.style
+            && edgeMargins == other.edgeMargins
+            && compositing == other.compositing
+            && rect == other.rect
+            && screen == other.screen;
+}
 
+void MainWindow::updateViewStruts()
+{
     if (m_settings->visibility() == DockSettings::AlwaysShow || m_activity->launchPad()) {
-        XWindowInterface::instance()->setViewStruts(this, m_settings->direction(), geometry(), compositing);
+        ViewStrut strut;
+        strut.enabled = true;
+        strut.direction = m_settings->direction();
+        strut.style = m_settings->style();
+        strut.edgeMargins = m_settings->edgeMargins();
+        strut.compositing = compositing();
+        strut.rect = geometry();
+        strut.screen = screen()->geometry();
+        applyViewStrut(strut);
     } else {
         clearViewStruts();
     }
@@ -308,7 +375,26 @@ void MainWindow::updateViewStruts()
 
 void MainWindow::clearViewStruts()
 {
-    XWindowInterface::instance()->clearViewStruts(this);
+    applyViewStrut(ViewStrut());
+}
+
+// Every strut change makes the window manager relayout maximized windows.
+void MainWindow::applyViewStrut(const ViewStrut &strut)
+{
+    if (m_strutApplied && strut == m_appliedStrut) {
+        ++m_suppressedWrites;
+        return;
+    }
+
+    if (strut.enabled)
+        WindowBackend::self()->setViewStruts(this, static_cast<DockSettings::Direction>(strut.direction),
+                                             strut.rect, strut.compositing);
+    else
+        WindowBackend::self()->clearViewStruts(this);
+
+    m_appliedStrut = strut;
+    m_strutApplied = true;
+    ++m_strutWrites;
 }
 
 void MainWindow::createFakeWindow()
@@ -371,17 +457,16 @@ void MainWindow::onPositionChanged()
         setVisible(false);
         initSlideWindow();
         // Setting geometry needs to be displayed, otherwise it will be invalid.
+        // Right away, not a frame later at the old edge.
         setVisible(true);
-        setGeometry(windowRect());
-        updateViewStruts();
+        applyGeometry();
 
         m_hideTimer->start();
     } else if (m_settings->visibility() == DockSettings::AlwaysShow) {
         setVisible(false);
         initSlideWindow();
         setVisible(true);
-        setGeometry(windowRect());
-        updateViewStruts();
+        applyGeometry();
     }
 
     emit directionChanged();
@@ -389,8 +474,7 @@ void MainWindow::onPositionChanged()
 
 void MainWindow::onIconSizeChanged()
 {
-    setGeometry(windowRect());
-    updateViewStruts();
+    resizeWindow();
 
     emit iconSizeChanged();
 }
@@ -411,9 +495,9 @@ void MainWindow::onVisibilityChanged()
     if (m_settings->visibility() == DockSettings::AlwaysShow) {
         m_hideTimer->stop();
 
-        setGeometry(windowRect());
+        // Sized before it is shown.
+        applyGeometry();
         setVisible(true);
-        updateViewStruts();
 
         // Delete fakewindow
         if (m_fakeWindow) {
@@ -423,7 +507,7 @@ void MainWindow::onVisibilityChanged()
 
     if (m_settings->visibility() == DockSettings::IntellHide) {
         clearViewStruts();
-        setGeometry(windowRect());
+        resizeWindow();
 
         if (m_activity->existsWindowMaximized() && !m_hideBlocked) {
             setVisible(false);
@@ -438,7 +522,7 @@ void MainWindow::onVisibilityChanged()
     // Always hide
     if (m_settings->visibility() == DockSettings::AlwaysHide) {
         clearViewStruts();
-        setGeometry(windowRect());
+        resizeWindow();
         setVisible(m_hideBlocked);
 
         // Create
@@ -45,6 +45,10 @@ public:
     void add(const QString &desktop);
     void remove(const QString &desktop);
     bool pinned(const QString &desktop);
+    QVariantMap launchMetrics() const;
+    QVariantMap itemStats() const;
+    QVariantMap windowCacheStats() const;
+    QVariantMap geometryStats() const;
 
     QRect primaryGeometry() const;
     int direction() const;
@@ -69,8 +73,25 @@ signals:
     void styleChanged();
 
 private:
+    // Everything the strut written for the dock depends on.
+    struct ViewStrut {
+        bool enabled = false;
+        int direction = -1;
+        int style = -1;
+        int edgeMargins = 0;
+        bool compositing = false;
+        QRect rect;
+        QRect screen;
+
+        bool operator==(const ViewStrut &other) const;
+        bool operator!=(const ViewStrut &other) const { return !(*this == other); }
+    };
+
     QRect windowRect() const;
     void resizeWindow();
+    void applyGeometry();
+    void applyViewStrut(const ViewStrut &strut);
+    bool compositing() const;
     void initScreens();
     void initSlideWindow();
     void updateViewStruts();
@@ -102,6 +123,16 @@ private:
 
     QTimer *m_showTimer;
     QTimer *m_hideTimer;
+
+    // Geometry and strut as last written, triggers within one
+    // event loop turn are applied once.
+    QTimer *m_geometryTimer;
+    QRect m_appliedRect;
+    ViewStrut m_appliedStrut;
+    bool m_strutApplied;
+    quint64 m_geometryWrites;
+    quint64 m_strutWrites;
+    quint64 m_suppressedWrites;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pinnedstore.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QSettings>
+
+// Changes closer together than this are written once.
+static const int QuietPeriod = 1000;
+
+PinnedStore::PinnedStore(const Snapshot &snapshot, QObject *parent)
+    : QObject(parent)
+    , m_snapshot(snapshot)
+    , m_fileName(QSettings(QSettings::UserScope, "lingmoos", "dock_pinned").fileName())
+    , m_quietTimer(new QTimer(this))
+{
+    m_pool.setMaxThreadCount(1);
+
+    m_quietTimer->setSingleShot(true);
+    m_quietTimer->setInterval(QuietPeriod);
+    connect(m_quietTimer, &QTimer::timeout, this, &PinnedStore::write);
+
+    connect(qApp, &QCoreApplication::aboutToQuit, this, &PinnedStore::flush);
+}
+
+PinnedStore::~PinnedStore()
+{
+    flush();
+}
+
+QString PinnedStore::fileName() const
+{
+    return m_fileName;
+}
+
+void PinnedStore::markDirty()
+{
+    m_quietTimer->start();
+}
+
+void PinnedStore::markClean()
+{
+    m_quietTimer->stop();
+    m_lastWritten = m_snapshot();
+}
+
+void PinnedStore::flush()
+{
+    if (m_quietTimer->isActive()) {
+        m_quietTimer->stop();
+        write();
+    }
+
+    m_pool.waitForDone();
+}
+
+void PinnedStore::write()
+{
+    const QList<Entry> entries = m_snapshot();
+
+    if (entries == m_lastWritten)
+        return;
+
+    m_lastWritten = entries;
+
+    const QString fileName = m_fileName;
+
+    // Queued in order on the one worker, the last one wins. QSettings
+    // replaces the file atomically.
+    m_pool.start([=] {
+        QSettings settings(fileName, QSettings::IniFormat);
+        settings.clear();
+
+        int index = 0;
+
+        for (const Entry &entry : entries) {
+            settings.beginGroup(entry.id);
+            settings.setValue("Index", index++);
+            settings.setValue("Icon", entry.iconName);
+            settings.setValue("VisibleName", entry.visibleName);
+            settings.setValue("Exec", entry.exec);
+            settings.setValue("DesktopPath", entry.desktopPath);
+            settings.setValue("Argv", entry.argv);
+            settings.endGroup();
+        }
+
+        settings.sync();
+
+        if (settings.status() != QSettings::NoError) {
+            qWarning() << "Failed to write" << fileName;
+
+            // Try again with the next change.
+            QMetaObject::invokeMethod(this, [=] { m_lastWritten.clear(); }, Qt::QueuedConnection);
+        }
+    });
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PINNEDSTORE_H
+#define PINNEDSTORE_H
+
+#include <QObject>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <functional>
+
+// Writes the pinned applications behind the GUI thread's back: changes
+// only mark the list dirty, and once they settle a copy of the list is
+// written through QSettings on a worker thread, unless it did not change
+// at all.
+class PinnedStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Entry {
+        QString id;
+        QString iconName;
+        QString visibleName;
+        QString exec;
+        QString desktopPath;
+        // Tokenized Exec, so that launches keep its quoting.
+        QStringList argv;
+
+        bool operator==(const Entry &other) const {
+            return id == other.id && iconName == other.iconName && visibleName == other.visibleName
+                    && exec == other.exec && desktopPath == other.desktopPath && argv == other.argv;
+        }
+    };
+
+    typedef std::function<QList<Entry>()> Snapshot;
+
+    explicit PinnedStore(const Snapshot &snapshot, QObject *parent = nullptr);
+    ~PinnedStore();
+
+    QString fileName() const;
+
+    void markDirty();
+    // The current list is what the file already holds.
+    void markClean();
+    // Writes a pending change now and waits for it.
+    void flush();
+
+private:
+    void write();
+
+private:
+    const Snapshot m_snapshot;
+    const QString m_fileName;
+
+    QThreadPool m_pool;
+    QTimer *m_quietTimer;
+    QList<Entry> m_lastWritten;
+};
+
+#endif // PINNEDSTORE_H
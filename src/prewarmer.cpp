@@ -0,0 +1,344 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "prewarmer.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <QStandardPaths>
+
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Per warm-up, big enough for a browser and its libraries.
+static const qint64 MaxBytes = 192 * 1024 * 1024;
+static const int MaxFiles = 256;
+// The page cache holds on to the files for much longer than this.
+static const qint64 Cooldown = 60 * 1000;
+
+static Prewarmer *SELF = nullptr;
+
+Prewarmer *Prewarmer::self()
+{
+    if (!SELF)
+        SELF = new Prewarmer;
+
+    return SELF;
+}
+
+Prewarmer::Prewarmer(QObject *parent)
+    : QObject(parent)
+    , m_searchPaths(librarySearchPaths())
+{
+    m_pool.setMaxThreadCount(1);
+    m_pool.setThreadPriority(QThread::LowestPriority);
+    m_clock.start();
+}
+
+void Prewarmer::warm(const QString &program)
+{
+    const QString binary = findBinary(program);
+
+    if (binary.isEmpty())
+        return;
+
+    auto last = m_lastWarm.constFind(binary);
+
+    if (last != m_lastWarm.constEnd() && m_clock.elapsed() - last.value() < Cooldown)
+        return;
+
+    // Hovering along the dock must not queue up one job per icon,
+    // anything that arrives while the worker is busy is dropped.
+    const bool started = m_pool.tryStart([=] {
+        qint64 budget = MaxBytes;
+
+        for (const QString &file : closure(binary)) {
+            const int fd = ::open(QFile::encodeName(file).constData(), O_RDONLY | O_CLOEXEC);
+
+            if (fd == -1)
+                continue;
+
+            struct stat st;
+
+            if (::fstat(fd, &st) == 0 && st.st_size <= budget) {
+                ::posix_fadvise(fd, 0, st.st_size, POSIX_FADV_WILLNEED);
+                budget -= st.st_size;
+            }
+
+            ::close(fd);
+
+            if (budget <= 0)
+                break;
+        }
+    });
+
+    if (started)
+        m_lastWarm.insert(binary, m_clock.elapsed());
+}
+
+void Prewarmer::evict(const QString &program)
+{
+    const QString binary = findBinary(program);
+
+    if (binary.isEmpty())
+        return;
+
+    m_pool.waitForDone();
+    m_lastWarm.remove(binary);
+
+    for (const QString &file : closure(binary)) {
+        const int fd = ::open(QFile::encodeName(file).constData(), O_RDONLY | O_CLOEXEC);
+
+        if (fd == -1)
+            continue;
+
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+    }
+}
+
+void Prewarmer::waitForDone()
+{
+    m_pool.waitForDone();
+}
+
+QString Prewarmer::findBinary(const QString &program)
+{
+    return program.contains('/') ? program : QStandardPaths::findExecutable(program);
+}
+
+QStringList Prewarmer::closure(const QString &binary)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_closures.constFind(binary);
+
+        if (it != m_closures.constEnd())
+            return it.value();
+    }
+
+    QStringList files { binary };
+    QSet<QString> seen { binary };
+
+    for (int i = 0; i < files.size() && files.size() < MaxFiles; ++i) {
+        const QString file = files.at(i);
+        const QString origin = QFileInfo(file).absolutePath();
+        QStringList runPaths;
+
+        for (const QString &name : neededLibraries(file, &runPaths)) {
+            const QString path = findLibrary(name, runPaths, origin);
+
+            if (!path.isEmpty() && !seen.contains(path)) {
+                seen.insert(path);
+                files.append(path);
+            }
+        }
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_closures.insert(binary, files);
+
+    return files;
+}
+
+QString Prewarmer::findLibrary(const QString &name, const QStringList &runPaths, const QString &origin) const
+{
+    if (name.contains('/'))
+        return QFileInfo::exists(name) ? name : QString();
+
+    for (QString dir : runPaths) {
+        dir.replace(QLatin1String("${ORIGIN}"), origin);
+        dir.replace(QLatin1String("$ORIGIN"), origin);
+
+        if (QFileInfo::exists(dir + '/' + name))
+            return dir + '/' + name;
+    }
+
+    for (const QString &dir : m_searchPaths) {
+        if (QFileInfo::exists(dir + '/' + name))
+            return dir + '/' + name;
+    }
+
+    return QString();
+}
+
+template<typename Ehdr, typename Phdr, typename Dyn>
+static QStringList readNeeded(const uchar *data, qint64 size, QStringList *runPaths)
+{
+    if (size < qint64(sizeof(Ehdr)))
+        return QStringList();
+
+    const Ehdr *ehdr = reinterpret_cast<const Ehdr *>(data);
+
+    if (ehdr->e_phentsize != sizeof(Phdr)
+            || quint64(ehdr->e_phoff) + quint64(ehdr->e_phnum) * sizeof(Phdr) > quint64(size))
+        return QStringList();
+
+    const Phdr *phdrs = reinterpret_cast<const Phdr *>(data + ehdr->e_phoff);
+    const Phdr *dynamic = nullptr;
+
+    for (int i = 0; i < ehdr->e_phnum; ++i) {
+        if (phdrs[i].p_type == PT_DYNAMIC)
+            dynamic = &phdrs[i];
+    }
+
+    if (!dynamic || quint64(dynamic->p_offset) + dynamic->p_filesz > quint64(size))
+        return QStringList();
+
+    // DT_STRTAB is an address, map it back to a file offset.
+    auto offsetOf = [&] (quint64 address) -> qint64 {
+        for (int i = 0; i < ehdr->e_phnum; ++i) {
+            const Phdr &phdr = phdrs[i];
+
+            if (phdr.p_type == PT_LOAD && address >= phdr.p_vaddr && address < phdr.p_vaddr + phdr.p_filesz)
+                return address - phdr.p_vaddr + phdr.p_offset;
+        }
+
+        return -1;
+    };
+
+    const Dyn *dyn = reinterpret_cast<const Dyn *>(data + dynamic->p_offset);
+    const quint64 count = dynamic->p_filesz / sizeof(Dyn);
+    qint64 strtab = -1;
+    QList<quint64> needed;
+    QList<quint64> paths;
+
+    for (quint64 i = 0; i < count && dyn[i].d_tag != DT_NULL; ++i) {
+        switch (dyn[i].d_tag) {
+        case DT_STRTAB:
+            strtab = offsetOf(dyn[i].d_un.d_ptr);
+            break;
+        case DT_NEEDED:
+            needed.append(dyn[i].d_un.d_val);
+            break;
+        case DT_RPATH:
+        case DT_RUNPATH:
+            paths.append(dyn[i].d_un.d_val);
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (strtab < 0)
+        return QStringList();
+
+    auto string = [&] (quint64 index) -> QString {
+        const quint64 offset = strtab + index;
+
+        if (offset >= quint64(size))
+            return QString();
+
+        const char *str = reinterpret_cast<const char *>(data + offset);
+        return QFile::decodeName(QByteArray(str, qstrnlen(str, size - offset)));
+    };
+
+    for (quint64 path : qAsConst(paths))
+        runPaths->append(string(path).split(':', Qt::SkipEmptyParts));
+
+    QStringList result;
+
+    for (quint64 name : qAsConst(needed)) {
+        const QString library = string(name);
+
+        if (!library.isEmpty())
+            result.append(library);
+    }
+
+    return result;
+}
+
+QStringList Prewarmer::neededLibraries(const QString &binary, QStringList *runPaths)
+{
+    QFile file(binary);
+
+    if (!file.open(QIODevice::ReadOnly) || file.size() < EI_NIDENT)
+        return QStringList();
+
+    const qint64 size = file.size();
+    const uchar *data = file.map(0, size);
+
+    // Scripts and foreign binaries are warmed on their own.
+    if (!data || memcmp(data, ELFMAG, SELFMAG) != 0)
+        return QStringList();
+
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    if (data[EI_DATA] != ELFDATA2LSB)
+        return QStringList();
+#else
+    if (data[EI_DATA] != ELFDATA2MSB)
+        return QStringList();
+#endif
+
+    if (data[EI_CLASS] == ELFCLASS64)
+        return readNeeded<Elf64_Ehdr, Elf64_Phdr, Elf64_Dyn>(data, size, runPaths);
+    if (data[EI_CLASS] == ELFCLASS32)
+        return readNeeded<Elf32_Ehdr, Elf32_Phdr, Elf32_Dyn>(data, size, runPaths);
+
+    return QStringList();
+}
+
+// Same order as the dynamic loader, minus its cache.
+QStringList Prewarmer::librarySearchPaths()
+{
+    QStringList dirs = qEnvironmentVariable("LD_LIBRARY_PATH").split(':', Qt::SkipEmptyParts);
+
+    readLdConfig("/etc/ld.so.conf", &dirs);
+    dirs << "/lib64" << "/usr/lib64" << "/lib" << "/usr/lib";
+    dirs.removeDuplicates();
+
+    return dirs;
+}
+
+void Prewarmer::readLdConfig(const QString &path, QStringList *dirs, int depth)
+{
+    QFile file(path);
+
+    if (depth > 4 || !file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return;
+
+    while (!file.atEnd()) {
+        QString line = QString::fromLocal8Bit(file.readLine());
+        const int comment = line.indexOf('#');
+
+        if (comment != -1)
+            line.truncate(comment);
+
+        line = line.trimmed();
+
+        if (line.startsWith(QLatin1String("include "))) {
+            QFileInfo pattern(line.mid(8).trimmed());
+
+            if (pattern.isRelative())
+                pattern = QFileInfo(QFileInfo(path).absolutePath() + '/' + pattern.filePath());
+
+            const QDir dir(pattern.absolutePath());
+
+            for (const QFileInfo &conf : dir.entryInfoList({ pattern.fileName() }, QDir::Files, QDir::Name))
+                readLdConfig(conf.filePath(), dirs, depth + 1);
+        } else if (!line.isEmpty()) {
+            dirs->append(line);
+        }
+    }
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PREWARMER_H
+#define PREWARMER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QStringList>
+#include <QThreadPool>
+
+// Pulls a program and the shared libraries it links against into the
+// page cache ahead of a likely launch, one program at a time.
+class Prewarmer : public QObject
+{
+    Q_OBJECT
+
+public:
+    static Prewarmer *self();
+    explicit Prewarmer(QObject *parent = nullptr);
+
+    void warm(const QString &program);
+
+    // For measuring cold launches: drops the program and its libraries
+    // from the page cache again, except for pages mapped by running
+    // processes, and lets the next warm() through right away.
+    void evict(const QString &program);
+    // Blocks until the warm-up in progress, if any, is done.
+    void waitForDone();
+
+private:
+    static QString findBinary(const QString &program);
+    QStringList closure(const QString &binary);
+    QString findLibrary(const QString &name, const QStringList &runPaths, const QString &origin) const;
+
+    static QStringList neededLibraries(const QString &binary, QStringList *runPaths);
+    static QStringList librarySearchPaths();
+    static void readLdConfig(const QString &path, QStringList *dirs, int depth = 0);
+
+private:
+    QThreadPool m_pool;
+    const QStringList m_searchPaths;
+
+    // Last warm-up of each program, against m_clock.
+    QElapsedTimer m_clock;
+    QHash<QString, qint64> m_lastWarm;
+
+    // Binary to itself plus its DT_NEEDED closure, filled by the worker.
+    QMutex m_mutex;
+    QHash<QString, QStringList> m_closures;
+};
+
+#endif // PREWARMER_H
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "processinfocache.h"
+
+#include <QFile>
+
+// Entries of processes without windows, e.g. parents, are
+// dropped once the cache grows past this.
+static const int MaxEntries = 512;
+
+static ProcessInfoCache *SELF = nullptr;
+
+ProcessInfoCache *ProcessInfoCache::self()
+{
+    if (!SELF)
+        SELF = new ProcessInfoCache;
+
+    return SELF;
+}
+
+const ProcessInfoCache::Info *ProcessInfoCache::info(quint32 pid)
+{
+    quint32 ppid = 0;
+    quint64 startTime = 0;
+
+    if (pid == 0 || !readStat(pid, &ppid, &startTime)) {
+        m_entries.remove(pid);
+        return nullptr;
+    }
+
+    auto it = m_entries.find(pid);
+
+    if (it != m_entries.end() && it->info.startTime == startTime)
+        return &it->info;
+
+    // New process, or the pid was reused.
+    Entry entry;
+    entry.info.pid = pid;
+    entry.info.ppid = ppid;
+    entry.info.startTime = startTime;
+    entry.windows = it != m_entries.end() ? it->windows : 0;
+
+    QFile file(QString("/proc/%1/cmdline").arg(pid));
+
+    if (file.open(QIODevice::ReadOnly)) {
+        const QByteArray cmd = file.readAll();
+
+        for (const QByteArray &arg : cmd.split('\0')) {
+            if (!arg.isEmpty())
+                entry.info.argv.append(QString::fromLocal8Bit(arg));
+        }
+    }
+
+    entry.info.exe = QFile::symLinkTarget(QString("/proc/%1/exe").arg(pid));
+    entry.info.unit = readUnit(pid);
+
+    if (m_entries.size() >= MaxEntries)
+        trim();
+
+    return &m_entries.insert(pid, entry)->info;
+}
+
+void ProcessInfoCache::retain(quint32 pid)
+{
+    if (pid != 0)
+        ++m_entries[pid].windows;
+}
+
+void ProcessInfoCache::release(quint32 pid)
+{
+    auto it = m_entries.find(pid);
+
+    if (it != m_entries.end() && --it->windows <= 0)
+        m_entries.erase(it);
+}
+
+bool ProcessInfoCache::hasWindows(quint32 pid) const
+{
+    return m_entries.value(pid).windows > 0;
+}
+
+bool ProcessInfoCache::readStat(quint32 pid, quint32 *ppid, quint64 *startTime)
+{
+    QFile file(QString("/proc/%1/stat").arg(pid));
+
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    const QByteArray stat = file.readAll();
+
+    // pid (comm) state ppid ..., comm may contain spaces and parentheses.
+    const int commEnd = stat.lastIndexOf(')');
+
+    if (commEnd == -1)
+        return false;
+
+    const QList<QByteArray> fields = stat.mid(commEnd + 2).split(' ');
+
+    // state is field 3 of proc(5), ppid 4 and starttime 22.
+    if (fields.size() < 20)
+        return false;
+
+    *ppid = fields.at(1).toUInt();
+    *startTime = fields.at(19).toULongLong();
+    return true;
+}
+
+QString ProcessInfoCache::readUnit(quint32 pid)
+{
+    QFile file(QString("/proc/%1/cgroup").arg(pid));
+
+    if (!file.open(QIODevice::ReadOnly))
+        return QString();
+
+    QByteArray path;
+
+    // hierarchy-ID:controllers:path, the unified hierarchy has ID 0
+    // and systemd's own legacy one is named "name=systemd".
+    for (const QByteArray &line : file.readAll().split('\n')) {
+        if (line.startsWith("0::")) {
+            path = line.mid(3);
+            break;
+        }
+
+        if (line.contains(":name=systemd:"))
+            path = line.mid(line.indexOf(":name=systemd:") + 14);
+    }
+
+    return QString::fromLocal8Bit(path.mid(path.lastIndexOf('/') + 1));
+}
+
+void ProcessInfoCache::trim()
+{
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (it->windows <= 0)
+            it = m_entries.erase(it);
+        else
+            ++it;
+    }
+}
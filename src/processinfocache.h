@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROCESSINFOCACHE_H
+#define PROCESSINFOCACHE_H
+
+#include <QHash>
+#include <QStringList>
+
+// Caches what the dock reads from /proc about window owners.
+// Entries are keyed by pid and start time, so a reused pid is
+// never mistaken for the process that owned it before.
+class ProcessInfoCache
+{
+public:
+    struct Info {
+        quint32 pid = 0;
+        quint32 ppid = 0;
+        quint64 startTime = 0;
+        QStringList argv;
+        // Target of /proc/<pid>/exe, empty if not readable.
+        QString exe;
+        // Last component of the systemd cgroup, e.g. app-gnome-firefox-1234.scope
+        QString unit;
+    };
+
+    static ProcessInfoCache *self();
+
+    // Valid until the next call, nullptr if the process is gone.
+    const Info *info(quint32 pid);
+
+    // Windows owned by the process, the entry is dropped with the last one.
+    void retain(quint32 pid);
+    void release(quint32 pid);
+    bool hasWindows(quint32 pid) const;
+
+private:
+    struct Entry {
+        Info info;
+        int windows = 0;
+    };
+
+    static bool readStat(quint32 pid, quint32 *ppid, quint64 *startTime);
+    static QString readUnit(quint32 pid);
+    void trim();
+
+private:
+    QHash<quint32, Entry> m_entries;
+};
+
+#endif // PROCESSINFOCACHE_H
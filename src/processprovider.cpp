@@ -18,25 +18,127 @@
  */
 
 #include "processprovider.h"
-#include <QDBusInterface>
-#include <QDBusPendingCall>
+
+#include <QDBusConnection>
+#include <QDBusError>
+#include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
+#include <QDBusServiceWatcher>
+#include <QElapsedTimer>
+#include <QProcess>
+
+static const QString SessionService = QStringLiteral("com.lingmo.Session");
+
+static ProcessProvider *SELF = nullptr;
+
+ProcessProvider *ProcessProvider::self()
+{
+    if (!SELF)
+        SELF = new ProcessProvider;
+
+    return SELF;
+}
 
 ProcessProvider::ProcessProvider(QObject *parent)
     : QObject(parent)
+    , m_serviceWatcher(new QDBusServiceWatcher(SessionService, QDBusConnection::sessionBus(),
+                                               QDBusServiceWatcher::WatchForOwnerChange, this))
+    , m_sessionAvailable(true)
 {
+    // Assume the session is there until a call says otherwise, asking
+    // the bus up front would block just the same.
+    connect(m_serviceWatcher, &QDBusServiceWatcher::serviceRegistered, this, [=] {
+        m_sessionAvailable = true;
+    });
+    connect(m_serviceWatcher, &QDBusServiceWatcher::serviceUnregistered, this, [=] {
+        m_sessionAvailable = false;
+    });
+}
+
+void ProcessProvider::launch(const QString &id, const QStringList &argv, const QStringList &environment)
+{
+    if (argv.isEmpty()) {
+        emit launchFinished(id, false, 0);
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (!m_sessionAvailable) {
+        const bool ok = spawn(argv, environment);
+        emit launchFinished(id, ok, timer.elapsed());
+        return;
+    }
+
+    // A plain method call, QDBusInterface would introspect the
+    // service synchronously every time.
+    QDBusMessage message = QDBusMessage::createMethodCall(SessionService,
+                                                          "/Session",
+                                                          "com.lingmo.Session",
+                                                          "launch");
+    message << argv.first() << QStringList(argv.mid(1));
 
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(QDBusConnection::sessionBus().asyncCall(message), this);
+
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [=] {
+        watcher->deleteLater();
+
+        bool ok = !watcher->isError();
+
+        if (!ok) {
+            const QDBusError::ErrorType type = watcher->error().type();
+
+            // The session is not running or too old to launch things,
+            // anything else is a genuine failure of the program itself.
+            if (type == QDBusError::ServiceUnknown
+                    || type == QDBusError::UnknownObject
+                    || type == QDBusError::UnknownInterface
+                    || type == QDBusError::UnknownMethod) {
+                if (type == QDBusError::ServiceUnknown)
+                    m_sessionAvailable = false;
+
+                ok = spawn(argv, environment);
+            }
+        }
+
+        emit launchFinished(id, ok, timer.elapsed());
+    });
 }
 
+// Started right here instead of through the session, so that the
+// caller gets the actual outcome.
 bool ProcessProvider::startDetached(const QString &exec, QStringList args)
 {
-    QDBusInterface iface("com.lingmo.Session",
-                         "/Session",
-                         "com.lingmo.Session", QDBusConnection::sessionBus());
+    QElapsedTimer timer;
+    timer.start();
+
+    args.prepend(exec);
+
+    const bool ok = self()->spawn(args, QStringList());
+    emit self()->launchFinished(exec, ok, timer.elapsed());
+
+    return ok;
+}
+
+// QProcess forks twice, so the program is reparented to init and the
+// dock never has a child of its own to wait for.
+bool ProcessProvider::spawn(const QStringList &argv, const QStringList &environment)
+{
+    QProcess process;
+    process.setProgram(argv.first());
+    process.setArguments(argv.mid(1));
+
+    if (!environment.isEmpty()) {
+        QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+
+        for (const QString &variable : environment) {
+            const int equals = variable.indexOf('=');
+            env.insert(variable.left(equals), variable.mid(equals + 1));
+        }
 
-    if (iface.isValid()) {
-        iface.asyncCall("launch", exec, args).waitForFinished();
-        return true;
+        process.setProcessEnvironment(env);
     }
 
-    return false;
+    return process.startDetached();
 }
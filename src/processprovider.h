@@ -22,14 +22,32 @@
 
 #include <QObject>
 
+class QDBusServiceWatcher;
 class ProcessProvider : public QObject
 {
     Q_OBJECT
 
 public:
+    static ProcessProvider *self();
+
     explicit ProcessProvider(QObject *parent = nullptr);
 
+    // Returns right away, the outcome is reported by launchFinished().
+    // The environment, as KEY=VALUE, only reaches programs started by
+    // the dock itself, the session's launch() does not take one.
+    void launch(const QString &id, const QStringList &argv, const QStringList &environment = QStringList());
+
     Q_INVOKABLE static bool startDetached(const QString &exec, QStringList args = QStringList());
+
+signals:
+    void launchFinished(const QString &id, bool ok, qint64 latency);
+
+private:
+    bool spawn(const QStringList &argv, const QStringList &environment);
+
+private:
+    QDBusServiceWatcher *m_serviceWatcher;
+    bool m_sessionAvailable;
 };
 
 #endif // PROCESSPROVIDER_H
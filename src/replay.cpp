@@ -0,0 +1,446 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Feeds a trace recorded with LINGMO_DOCK_TRACE into ApplicationModel
+// through the synthetic backend, and reports how long each event took
+// to reach the model and what the model looked like at the end.
+//
+// With --soak it opens and closes random windows instead, and fails if
+// the model does not give back its items afterwards.
+//
+// With --launch it starts a real application over and over, with and
+// without pre-warming, and reports the time from the click to its first
+// window as recorded in the model's launch metrics.
+
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QHash>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QTimer>
+
+#include <algorithm>
+#include <functional>
+
+#include <unistd.h>
+
+#include "applicationmodel.h"
+#include "desktopfileparser.h"
+#include "docksettings.h"
+#include "prewarmer.h"
+#include "syntheticbackend.h"
+#include "windowtrace.h"
+
+static qint64 percentile(QList<qint64> values, double p)
+{
+    if (values.isEmpty())
+        return 0;
+
+    std::sort(values.begin(), values.end());
+    return values.at(qMin(values.size() - 1, int(p * values.size())));
+}
+
+// The model loads and writes the pinned list, and the application
+// index writes its cache. Both go to a throwaway home instead of the
+// user's, which also keeps results independent of the desktop.
+static bool isolate(const QTemporaryDir &home)
+{
+    if (!home.isValid())
+        return false;
+
+    qputenv("XDG_CONFIG_HOME", QFile::encodeName(home.filePath("config")));
+    qputenv("XDG_CACHE_HOME", QFile::encodeName(home.filePath("cache")));
+    qputenv("XDG_DATA_HOME", QFile::encodeName(home.filePath("data")));
+    return true;
+}
+
+static qint64 residentKiB()
+{
+    QFile file("/proc/self/statm");
+
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+
+    const QList<QByteArray> fields = file.readAll().split(' ');
+    return fields.value(1).toLongLong() * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Windows are opened and closed in batches, each batch gets a flush of
+// the model to itself.
+static int soak(QGuiApplication &app, int total)
+{
+    static const int BatchSize = 500;
+    static const int FlushDelay = 40;
+    // Same bound as tst_applicationmodel, in KiB.
+    static const qint64 MaxRssGrowth = 4 * 1024;
+
+    QTemporaryDir home;
+
+    if (!isolate(home)) {
+        QTextStream(stderr) << "Cannot create a temporary home: " << home.errorString() << Qt::endl;
+        return 1;
+    }
+
+    SyntheticBackend *backend = static_cast<SyntheticBackend *>(WindowBackend::self());
+    ApplicationModel model;
+    QTextStream out(stdout);
+
+    QVariantMap baseline;
+    qint64 baselineRss = 0;
+    QList<quint64> open;
+    int opened = 0;
+    std::function<void()> step;
+
+    step = [&] {
+        if (!open.isEmpty()) {
+            for (quint64 wid : qAsConst(open))
+                backend->removeWindow(wid);
+
+            open.clear();
+        } else if (opened < total) {
+            for (int i = 0; i < BatchSize && opened < total; ++i, ++opened)
+                open.append(backend->addWindow(backend->randomWindow()));
+
+            if (opened % 10000 < BatchSize)
+                out << opened << " windows, rss " << residentKiB() << " KiB" << Qt::endl;
+        } else {
+            const QVariantMap stats = model.itemStats();
+            const qint64 rss = residentKiB();
+            const bool itemsOk = stats.value("live") == baseline.value("live")
+                    && stats.value("allocated").toInt() <= baseline.value("allocated").toInt();
+            const bool rssOk = rss - baselineRss <= MaxRssGrowth;
+
+            out << "items:  live " << baseline.value("live").toInt() << " -> " << stats.value("live").toInt()
+                << ", allocated " << baseline.value("allocated").toInt() << " -> " << stats.value("allocated").toInt() << Qt::endl;
+            out << "rss:    " << baselineRss << " -> " << rss << " KiB, at most +" << MaxRssGrowth << Qt::endl;
+            out << (!itemsOk ? "items leaked" : !rssOk ? "memory grew" : "ok") << Qt::endl;
+
+            app.exit(itemsOk && rssOk ? 0 : 1);
+            return;
+        }
+
+        QTimer::singleShot(FlushDelay, &app, step);
+    };
+
+    // After the pinned applications are loaded.
+    QTimer::singleShot(200, &app, [&] {
+        baseline = model.itemStats();
+        baselineRss = residentKiB();
+        step();
+    });
+
+    return app.exec();
+}
+
+// Runs alternate between cold and pre-warmed. Before each one the
+// program and its libraries are evicted from the page cache, which
+// needs no privileges, unlike dropping every cache.
+static int launch(QGuiApplication &app, const QString &desktopPath, int runs)
+{
+    static const int MaxCloseWait = 10000;
+    static const int SettleDelay = 1000;
+
+    QTemporaryDir home;
+
+    if (!isolate(home)) {
+        QTextStream(stderr) << "Cannot create a temporary home: " << home.errorString() << Qt::endl;
+        return 1;
+    }
+
+    SystemAppItem *entry = SystemAppMonitor::self()->find(desktopPath);
+
+    if (!entry || entry->argv.isEmpty()) {
+        QTextStream(stderr) << "Not an application installed system-wide: " << desktopPath << Qt::endl;
+        return 1;
+    }
+
+    const QString program = entry->argv.value(DesktopFileParser::programIndex(entry->argv));
+    // What launchMetrics() is keyed by.
+    const QString key = QFileInfo(desktopPath).completeBaseName();
+
+    ApplicationModel model;
+    model.addItem(desktopPath);
+
+    QTextStream out(stdout);
+    QList<qint64> latencies[2];
+    int failures[2] = { 0, 0 };
+    int run = 0;
+    QMetaObject::Connection mapped;
+    QElapsedTimer closing;
+    std::function<void()> step;
+    std::function<void()> settle;
+
+    // Windows give the item their own id, the desktop file stays.
+    auto row = [&] {
+        for (int i = 0; i < model.rowCount(); ++i) {
+            if (model.index(i, 0).data(ApplicationModel::DesktopFileRole).toString() == desktopPath)
+                return model.index(i, 0);
+        }
+
+        return QModelIndex();
+    };
+
+    auto stats = [&] {
+        return model.launchMetrics().value(key).toMap();
+    };
+
+    auto report = [&] {
+        const char *const modes[] = { "cold:      ", "prewarmed: " };
+
+        for (int mode = 0; mode < 2; ++mode) {
+            qint64 total = 0;
+
+            for (qint64 latency : qAsConst(latencies[mode]))
+                total += latency;
+
+            out << modes[mode] << "runs " << latencies[mode].size()
+                << "  failed " << failures[mode]
+                << "  p50 " << percentile(latencies[mode], 0.5)
+                << " ms  average " << (latencies[mode].isEmpty() ? 0 : total / latencies[mode].size())
+                << " ms  max " << percentile(latencies[mode], 1) << " ms" << Qt::endl;
+        }
+
+        app.exit(latencies[0].isEmpty() || latencies[1].isEmpty() ? 1 : 0);
+    };
+
+    // Until the last run's windows are gone, then a little longer for
+    // the process to exit.
+    settle = [&] {
+        if (row().data(ApplicationModel::WindowCountRole).toInt() > 0 && closing.elapsed() < MaxCloseWait)
+            QTimer::singleShot(100, &app, settle);
+        else
+            QTimer::singleShot(SettleDelay, &app, step);
+    };
+
+    step = [&] {
+        if (run == runs * 2) {
+            report();
+            return;
+        }
+
+        const bool prewarm = run % 2 == 1;
+        const QString id = row().data(ApplicationModel::AppIdRole).toString();
+
+        Prewarmer::self()->evict(program);
+        DockSettings::self()->setPreWarmEnabled(prewarm);
+
+        // As if the pointer rested on the icon long enough before the click.
+        if (prewarm) {
+            model.preWarm(id);
+            Prewarmer::self()->waitForDone();
+        }
+
+        const int count = stats().value("count").toInt();
+        const int failed = stats().value("failures").toInt();
+
+        mapped = QObject::connect(&model, &ApplicationModel::dataChanged, &app, [&, prewarm, count, failed] {
+            const QVariantMap current = stats();
+
+            if (current.value("count").toInt() == count)
+                return;
+
+            QObject::disconnect(mapped);
+
+            if (current.value("failures").toInt() > failed) {
+                ++failures[prewarm];
+                out << "run " << run + 1 << (prewarm ? "  prewarmed  " : "  cold       ") << "failed" << Qt::endl;
+            } else {
+                latencies[prewarm].append(current.value("last").toLongLong());
+                out << "run " << run + 1 << (prewarm ? "  prewarmed  " : "  cold       ")
+                    << current.value("last").toLongLong() << " ms" << Qt::endl;
+            }
+
+            ++run;
+            model.closeAllByAppId(row().data(ApplicationModel::AppIdRole).toString());
+            closing.start();
+            settle();
+        });
+
+        if (!model.openNewInstance(id)) {
+            QObject::disconnect(mapped);
+            QTextStream(stderr) << "Cannot launch " << desktopPath << Qt::endl;
+            app.exit(1);
+        }
+    };
+
+    // After the windows that are already open have been picked up.
+    QTimer::singleShot(500, &app, step);
+
+    return app.exec();
+}
+
+int main(int argc, char *argv[])
+{
+    // Launches need the real window system to see their windows map.
+    bool launching = false;
+
+    for (int i = 1; i < argc; ++i)
+        launching = launching || qstrcmp(argv[i], "--launch") == 0 || qstrncmp(argv[i], "--launch=", 9) == 0;
+
+    if (!launching) {
+        if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+            qputenv("QT_QPA_PLATFORM", "offscreen");
+
+        // Nothing but the trace.
+        qputenv("LINGMO_DOCK_BACKEND", "synthetic");
+        qputenv("LINGMO_DOCK_SYNTHETIC_WINDOWS", "0");
+        qputenv("LINGMO_DOCK_SYNTHETIC_RATE", "0");
+    }
+
+    QGuiApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays a lingmo-dock window trace.");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("realtime", "Keep the recorded timing instead of replaying as fast as possible."));
+    parser.addOption(QCommandLineOption("soak", "Open and close <windows> random windows instead of replaying a trace.", "windows"));
+    parser.addOption(QCommandLineOption("launch", "Measure launch to first window of <desktop file> instead of replaying a trace.", "desktop file"));
+    parser.addOption(QCommandLineOption("runs", "Launches with and without pre-warming each, for --launch.", "runs", "5"));
+    parser.addPositionalArgument("trace", "Trace file recorded with LINGMO_DOCK_TRACE.");
+    parser.process(app);
+
+    if (parser.isSet("soak"))
+        return soak(app, parser.value("soak").toInt());
+
+    if (parser.isSet("launch"))
+        return launch(app, QFileInfo(parser.value("launch")).absoluteFilePath(), qMax(1, parser.value("runs").toInt()));
+
+    if (parser.positionalArguments().size() != 1)
+        parser.showHelp(1);
+
+    QTextStream out(stdout);
+    WindowTraceReader reader(parser.positionalArguments().first());
+
+    if (!reader.isOpen()) {
+        QTextStream(stderr) << "Not a window trace: " << parser.positionalArguments().first() << Qt::endl;
+        return 1;
+    }
+
+    QTemporaryDir home;
+
+    if (!isolate(home)) {
+        QTextStream(stderr) << "Cannot create a temporary home: " << home.errorString() << Qt::endl;
+        return 1;
+    }
+
+    const bool realTime = parser.isSet("realtime");
+    SyntheticBackend *backend = static_cast<SyntheticBackend *>(WindowBackend::self());
+    ApplicationModel model;
+
+    QElapsedTimer clock;
+    QHash<quint64, quint64> wids;
+    QList<qint64> pending;
+    QList<qint64> latencies;
+    QList<qint64> flushes;
+    int replayed = 0;
+
+    // Every event the model saw is done once the batch holding it is applied.
+    QObject::connect(&model, &ApplicationModel::windowEventsFlushed, &app, [&] (int, qint64 nsecs) {
+        const qint64 now = clock.nsecsElapsed();
+
+        for (qint64 time : qAsConst(pending))
+            latencies.append(now - time);
+
+        pending.clear();
+        flushes.append(nsecs);
+    });
+
+    auto report = [&] {
+        out << "events:      " << replayed << Qt::endl;
+        out << "wall time:   " << clock.elapsed() << " ms" << Qt::endl;
+        out << "latency us:  p50 " << percentile(latencies, 0.5) / 1000
+            << "  p90 " << percentile(latencies, 0.9) / 1000
+            << "  p99 " << percentile(latencies, 0.99) / 1000
+            << "  max " << percentile(latencies, 1) / 1000 << Qt::endl;
+        out << "flushes:     " << flushes.size()
+            << "  p50 " << percentile(flushes, 0.5) / 1000
+            << " us  p99 " << percentile(flushes, 0.99) / 1000
+            << " us  max " << percentile(flushes, 1) / 1000 << " us" << Qt::endl;
+
+        out << "model:" << Qt::endl;
+
+        for (int row = 0; row < model.rowCount(); ++row) {
+            const QModelIndex index = model.index(row, 0);
+            out << "  " << index.data(ApplicationModel::AppIdRole).toString()
+                << "\twindows=" << index.data(ApplicationModel::WindowCountRole).toInt()
+                << "\tpinned=" << index.data(ApplicationModel::IsPinnedRole).toBool()
+                << "\t" << index.data(ApplicationModel::DesktopFileRole).toString() << Qt::endl;
+        }
+
+        app.quit();
+    };
+
+    WindowTrace::Event event;
+    std::function<void()> step;
+
+    step = [&] {
+        switch (event.type) {
+        case WindowTrace::Added: {
+            const quint64 wid = backend->addWindow(event.properties);
+            wids.insert(event.wid, wid);
+
+            if (backend->isAcceptableWindow(wid))
+                pending.append(clock.nsecsElapsed());
+            break;
+        }
+        case WindowTrace::Removed: {
+            const quint64 wid = wids.take(event.wid);
+
+            if (backend->isAcceptableWindow(wid))
+                pending.append(clock.nsecsElapsed());
+
+            backend->removeWindow(wid);
+            break;
+        }
+        case WindowTrace::Changed:
+            backend->changeWindow(wids.value(event.wid), event.properties);
+            break;
+        case WindowTrace::Activated:
+            pending.append(clock.nsecsElapsed());
+            backend->setActiveWindow(wids.value(event.wid));
+            break;
+        }
+
+        ++replayed;
+
+        if (!reader.next(&event)) {
+            // Let the last batch reach the model.
+            QTimer::singleShot(100, &app, report);
+            return;
+        }
+
+        const qint64 delay = realTime ? qMax<qint64>(0, event.time / 1000 - clock.elapsed()) : 0;
+        QTimer::singleShot(delay, &app, step);
+    };
+
+    // Give the model time to load the pinned applications first.
+    QTimer::singleShot(200, &app, [&] {
+        clock.start();
+
+        if (reader.next(&event))
+            step();
+        else
+            report();
+    });
+
+    return app.exec();
+}
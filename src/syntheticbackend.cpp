@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "syntheticbackend.h"
+#include "utils.h"
+
+#include <cctype>
+
+static const char *const Classes[] = {
+    "firefox", "chromium", "thunderbird", "code", "qtcreator", "org.kde.konsole",
+    "lingmo-terminal", "lingmo-filemanager", "org.gnome.Nautilus", "dolphin", "kate",
+    "gedit", "okular", "evince", "libreoffice-writer", "libreoffice-calc", "gimp",
+    "inkscape", "krita", "blender", "vlc", "obs", "steam", "discord", "virt-manager"
+};
+
+// Beyond the well known ones, classes that match no desktop file.
+static const int UnknownClasses = 40;
+
+static quint32 seed()
+{
+    bool ok = false;
+    const int seed = qEnvironmentVariableIntValue("LINGMO_DOCK_SYNTHETIC_SEED", &ok);
+
+    return ok ? quint32(seed) : 1;
+}
+
+SyntheticBackend::SyntheticBackend(QObject *parent)
+    : WindowBackend(parent)
+    , m_random(seed())
+    , m_nextWid(0x1000)
+    , m_activeWindow(0)
+    , m_initialWindows(20)
+    , m_eventTimer(new QTimer(this))
+    , m_eventRate(0)
+    , m_generated(0)
+    , m_iconGeometries(0)
+{
+    bool ok = false;
+    const int windows = qEnvironmentVariableIntValue("LINGMO_DOCK_SYNTHETIC_WINDOWS", &ok);
+
+    if (ok)
+        m_initialWindows = qMax(0, windows);
+
+    m_eventTimer->setInterval(10);
+    connect(m_eventTimer, &QTimer::timeout, this, &SyntheticBackend::generateEvents);
+
+    setEventRate(qEnvironmentVariableIntValue("LINGMO_DOCK_SYNTHETIC_RATE"));
+}
+
+QList<quint64> SyntheticBackend::windows()
+{
+    return m_order;
+}
+
+WId SyntheticBackend::activeWindow()
+{
+    return m_activeWindow;
+}
+
+SyntheticBackend::WindowProperties SyntheticBackend::properties(quint64 wid)
+{
+    return m_windows.value(wid);
+}
+
+QString SyntheticBackend::desktopFilePath(quint64 wid)
+{
+    const WindowProperties properties = m_windows.value(wid);
+
+    // There is no process behind the window, pretend it runs the
+    // binary it is named after.
+    return Utils::instance()->matchWindow(properties.windowClass, properties.instanceName,
+                                          "/usr/bin/" + properties.instanceName).path;
+}
+
+void SyntheticBackend::startInitWindows()
+{
+    QList<quint64> accepted;
+
+    for (int i = 0; i < m_initialWindows; ++i) {
+        const WindowProperties properties = randomWindow();
+        const quint64 wid = m_nextWid++;
+
+        m_windows.insert(wid, properties);
+        m_positions.insert(wid, m_order.size());
+        m_order.append(wid);
+
+        if (isAcceptable(wid, properties))
+            accepted.append(wid);
+    }
+
+    emit windowsAdded(accepted);
+}
+
+void SyntheticBackend::forceActiveWindow(WId win)
+{
+    setActiveWindow(win);
+}
+
+void SyntheticBackend::minimizeWindow(WId win)
+{
+    auto it = m_windows.find(win);
+
+    if (it != m_windows.end()) {
+        it->state |= NET::Hidden;
+        emit windowChanged(win);
+    }
+}
+
+void SyntheticBackend::closeWindow(WId win)
+{
+    removeWindow(win);
+}
+
+void SyntheticBackend::setIconGeometry(quint64 wid, const QRect &rect)
+{
+    Q_UNUSED(wid)
+    Q_UNUSED(rect)
+
+    ++m_iconGeometries;
+}
+
+QVariantMap SyntheticBackend::cacheStats() const
+{
+    QVariantMap stats;
+    stats.insert("windows", m_windows.size());
+    stats.insert("events", m_generated);
+    stats.insert("iconGeometries", m_iconGeometries);
+    return stats;
+}
+
+quint64 SyntheticBackend::addWindow(const WindowProperties &properties)
+{
+    const quint64 wid = m_nextWid++;
+
+    m_windows.insert(wid, properties);
+    m_positions.insert(wid, m_order.size());
+    m_order.append(wid);
+
+    if (isAcceptable(wid, properties))
+        emit windowAdded(wid);
+
+    return wid;
+}
+
+void SyntheticBackend::removeWindow(quint64 wid)
+{
+    const int position = m_positions.value(wid, -1);
+
+    if (position == -1)
+        return;
+
+    // Swap with the last one, the order is not meaningful.
+    const quint64 last = m_order.takeLast();
+
+    if (last != wid) {
+        m_order[position] = last;
+        m_positions.insert(last, position);
+    }
+
+    m_positions.remove(wid);
+    m_windows.remove(wid);
+
+    if (m_activeWindow == wid)
+        setActiveWindow(0);
+
+    emit windowRemoved(wid);
+}
+
+void SyntheticBackend::changeWindow(quint64 wid, const WindowProperties &properties)
+{
+    auto it = m_windows.find(wid);
+
+    if (it != m_windows.end()) {
+        it.value() = properties;
+        emit windowChanged(wid);
+    }
+}
+
+void SyntheticBackend::setActiveWindow(quint64 wid)
+{
+    if (m_activeWindow != wid) {
+        m_activeWindow = wid;
+        emit activeChanged(wid);
+    }
+}
+
+SyntheticBackend::WindowProperties SyntheticBackend::randomWindow()
+{
+    const int known = int(sizeof(Classes) / sizeof(Classes[0]));
+    const int index = m_random.bounded(known + UnknownClasses);
+
+    WindowProperties properties;
+    properties.valid = true;
+    properties.type = NET::Normal;
+    properties.instanceName = index < known ? QByteArray(Classes[index])
+                                            : "synthetic-" + QByteArray::number(index - known);
+    properties.windowClass = properties.instanceName;
+    properties.windowClass[0] = char(toupper(properties.windowClass.at(0)));
+    properties.name = QString::fromLatin1(properties.windowClass) + ' ' + QString::number(m_nextWid);
+
+    // Some dialogs and some windows that stay off the taskbar.
+    const int kind = m_random.bounded(100);
+
+    if (kind < 10 && !m_order.isEmpty()) {
+        properties.type = NET::Dialog;
+        properties.transientFor = m_order.at(m_random.bounded(m_order.size()));
+        properties.transientForType = NET::Normal;
+    } else if (kind < 15) {
+        properties.state |= NET::SkipTaskbar;
+    }
+
+    return properties;
+}
+
+void SyntheticBackend::setEventRate(int eventsPerSecond)
+{
+    m_eventRate = qMax(0, eventsPerSecond);
+
+    if (m_eventRate == 0) {
+        m_eventTimer->stop();
+        return;
+    }
+
+    m_generated = 0;
+    m_clock.start();
+    m_eventTimer->start();
+}
+
+// Catches up with the configured rate on every tick, so the rate holds
+// even when the model is slower than the timer.
+void SyntheticBackend::generateEvents()
+{
+    const qint64 due = m_clock.elapsed() * m_eventRate / 1000;
+
+    while (m_generated < due) {
+        randomEvent();
+        ++m_generated;
+    }
+}
+
+void SyntheticBackend::randomEvent()
+{
+    const int action = m_random.bounded(100);
+
+    // Keep the window count around where it started.
+    if (m_order.isEmpty() || (action < 30 && m_order.size() <= m_initialWindows)) {
+        addWindow(randomWindow());
+        return;
+    }
+
+    const quint64 wid = m_order.at(m_random.bounded(m_order.size()));
+
+    if (action < 55) {
+        removeWindow(wid);
+    } else if (action < 80) {
+        setActiveWindow(wid);
+    } else {
+        WindowProperties properties = m_windows.value(wid);
+        properties.name = QString::fromLatin1(properties.windowClass) + ' ' + QString::number(m_random.generate());
+        changeWindow(wid, properties);
+    }
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SYNTHETICBACKEND_H
+#define SYNTHETICBACKEND_H
+
+#include "windowbackend.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QRandomGenerator>
+#include <QTimer>
+
+// Windows made up in process, for measuring the model and the desktop
+// file matching without an X server. Runs are reproducible for a given
+// seed; configured through LINGMO_DOCK_SYNTHETIC_SEED, _WINDOWS (at
+// startup) and _RATE (random events per second, 0 for none).
+class SyntheticBackend : public WindowBackend
+{
+    Q_OBJECT
+
+public:
+    explicit SyntheticBackend(QObject *parent = nullptr);
+
+    QList<quint64> windows() override;
+    WId activeWindow() override;
+    WindowProperties properties(quint64 wid) override;
+    QString desktopFilePath(quint64 wid) override;
+
+    void startInitWindows() override;
+
+    void forceActiveWindow(WId win) override;
+    void minimizeWindow(WId win) override;
+    void closeWindow(WId win) override;
+    void setIconGeometry(quint64 wid, const QRect &rect) override;
+
+    QVariantMap cacheStats() const override;
+
+    // Drive the backend directly, e.g. from a trace.
+    quint64 addWindow(const WindowProperties &properties);
+    void removeWindow(quint64 wid);
+    void changeWindow(quint64 wid, const WindowProperties &properties);
+    void setActiveWindow(quint64 wid);
+
+    WindowProperties randomWindow();
+    void setEventRate(int eventsPerSecond);
+
+private:
+    void generateEvents();
+    void randomEvent();
+
+private:
+    QRandomGenerator m_random;
+    QHash<quint64, WindowProperties> m_windows;
+    // Creation order, with m_positions for O(1) removal.
+    QList<quint64> m_order;
+    QHash<quint64, int> m_positions;
+    quint64 m_nextWid;
+    quint64 m_activeWindow;
+    int m_initialWindows;
+
+    QTimer *m_eventTimer;
+    QElapsedTimer m_clock;
+    int m_eventRate;
+    qint64 m_generated;
+    quint64 m_iconGeometries;
+};
+
+#endif // SYNTHETICBACKEND_H
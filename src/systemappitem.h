@@ -36,7 +36,8 @@ public:
     QString iconName;
     QString startupWMClass;
     QString exec;
-    QStringList args;
+    // Exec split per the spec, ready to launch.
+    QStringList argv;
 };
 
 #endif // SYSTEMAPPITEM_H
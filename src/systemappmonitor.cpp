@@ -18,25 +18,64 @@
  */
 
 #include "systemappmonitor.h"
+#include "desktopfileparser.h"
+#include "appindexcache.h"
 
 #include <QFileSystemWatcher>
-#include <QRegularExpression>
 #include <QDirIterator>
-#include <QSettings>
+#include <QDir>
+#include <QFileInfo>
 #include <QLocale>
+#include <QSet>
+#include <QtConcurrent>
 
-#define SystemApplicationsFolder "/usr/share/applications"
+#include <sys/stat.h>
 
 static SystemAppMonitor *SELF = nullptr;
 
-static QByteArray detectDesktopEnvironment()
+// All applications folders, from the highest precedence to the lowest.
+// ref: https://specifications.freedesktop.org/basedir-spec/latest/
+static QStringList applicationsFolders()
 {
-    const QByteArray desktop = qgetenv("XDG_CURRENT_DESKTOP");
+    QString dataHome = qEnvironmentVariable("XDG_DATA_HOME");
+    QString dataDirs = qEnvironmentVariable("XDG_DATA_DIRS");
+
+    if (dataHome.isEmpty())
+        dataHome = QDir::homePath() + "/.local/share";
+
+    // Without XDG_DATA_DIRS, the default plus the Flatpak and Snap
+    // exports a session would normally have added. A set value is
+    // taken as it is, it decides the precedence.
+    if (dataDirs.isEmpty()) {
+        dataDirs = "/usr/local/share:/usr/share:"
+                + dataHome + "/flatpak/exports/share:"
+                "/var/lib/flatpak/exports/share:"
+                "/var/lib/snapd/desktop";
+    }
+
+    QStringList folders;
+    folders << dataHome << dataDirs.split(':', Qt::SkipEmptyParts);
+
+    QStringList result;
+
+    for (const QString &folder : qAsConst(folders)) {
+        const QString path = QDir::cleanPath(folder) + "/applications";
+
+        if (!result.contains(path))
+            result.append(path);
+    }
+
+    return result;
+}
+
+static QStringList currentDesktops()
+{
+    const QString desktop = QString::fromLocal8Bit(qgetenv("XDG_CURRENT_DESKTOP"));
 
     if (!desktop.isEmpty())
-        return desktop.toUpper();
+        return desktop.split(':', Qt::SkipEmptyParts);
 
-    return QByteArray("UNKNOWN");
+    return { "UNKNOWN" };
 }
 
 SystemAppMonitor *SystemAppMonitor::self()
@@ -49,10 +88,33 @@ SystemAppMonitor *SystemAppMonitor::self()
 
 SystemAppMonitor::SystemAppMonitor(QObject *parent)
     : QObject(parent)
+    , m_roots(applicationsFolders())
+    , m_watcher(new QFileSystemWatcher(this))
+    , m_refreshTimer(new QTimer(this))
+    , m_cache(new AppIndexCache(QLocale::system().name(), currentDesktops(), m_roots))
 {
-    QFileSystemWatcher *watcher = new QFileSystemWatcher(this);
-    watcher->addPath(SystemApplicationsFolder);
-    connect(watcher, &QFileSystemWatcher::directoryChanged, this, &SystemAppMonitor::refresh);
+    // Package upgrades touch the folders many times in a row,
+    // only rescan once things have settled down.
+    m_refreshTimer->setSingleShot(true);
+    m_refreshTimer->setInterval(500);
+    connect(m_refreshTimer, &QTimer::timeout, this, &SystemAppMonitor::refresh);
+
+    // Every directory is watched on its own, so only the one that
+    // fired has to be listed again.
+    connect(m_watcher, &QFileSystemWatcher::directoryChanged, this, [=] (const QString &path) {
+        // Missing roots are looked at again whenever the closest
+        // folder above them that does exist changes.
+        for (const QString &root : m_anchors.value(path))
+            m_dirtyDirs.insert(root);
+
+        if (!m_anchors.contains(path) || m_dirStats.value(path) != 0)
+            m_dirtyDirs.insert(path);
+
+        m_refreshTimer->start();
+    });
+
+    // Start from the cache and only parse what changed since.
+    loadCache();
     refresh();
 }
 
@@ -60,99 +122,542 @@ SystemAppMonitor::~SystemAppMonitor()
 {
     while (!m_items.isEmpty())
         delete m_items.takeFirst();
+
+    delete m_cache;
 }
 
 SystemAppItem *SystemAppMonitor::find(const QString &filePath)
 {
-    for (SystemAppItem *item : m_items)
-        if (item->path == filePath)
-            return item;
+    return m_pathIndex.value(filePath, nullptr);
+}
+
+bool SystemAppMonitor::covers(const QString &filePath) const
+{
+    return m_dirStats.contains(filePath.left(filePath.lastIndexOf('/')));
+}
 
-    return nullptr;
+bool SystemAppMonitor::contains(const QString &filePath) const
+{
+    return m_pathIndex.contains(filePath) || m_entryStats.contains(filePath);
 }
 
-void SystemAppMonitor::refresh()
+SystemAppItem *SystemAppMonitor::findByExecName(const QString &name)
+{
+    return m_execNameIndex.value(name.toLower(), nullptr);
+}
+
+SystemAppItem *SystemAppMonitor::findByExecPath(const QString &path)
 {
-    QStringList addedEntries;
-    for (SystemAppItem *item : m_items)
-        addedEntries.append(item->path);
+    return m_execPathIndex.value(path.toLower(), nullptr);
+}
 
-    QStringList allEntries;
-    QDirIterator it(SystemApplicationsFolder, { "*.desktop" }, QDir::NoFilter, QDirIterator::Subdirectories);
+SystemAppItem *SystemAppMonitor::findByStartupWMClass(const QString &wmClass)
+{
+    return m_wmClassIndex.value(wmClass.toLower(), nullptr);
+}
 
-    while (it.hasNext()) {
-        const QString &filePath = it.next();
+SystemAppItem *SystemAppMonitor::findByIconName(const QString &iconName)
+{
+    return m_iconIndex.value(iconName.toLower(), nullptr);
+}
+
+SystemAppItem *SystemAppMonitor::findByDesktopName(const QString &name)
+{
+    return m_desktopNameIndex.value(name.toLower(), nullptr);
+}
+
+bool SystemAppMonitor::statEntry(const QString &filePath, EntryStat *entry)
+{
+    struct stat buf;
+
+    if (::stat(QFile::encodeName(filePath).constData(), &buf) != 0)
+        return false;
+
+    entry->mtime = qint64(buf.st_mtim.tv_sec) * 1000000000 + buf.st_mtim.tv_nsec;
+    entry->size = buf.st_size;
+    entry->inode = buf.st_ino;
+    return true;
+}
+
+SystemAppItem *SystemAppMonitor::findByDesktopId(const QString &desktopId)
+{
+    const QString path = m_winners.value(desktopId);
+
+    return path.isEmpty() ? nullptr : find(path);
+}
+
+QList<SystemAppItem *> SystemAppMonitor::candidates(IndexKey key, const QString &value) const
+{
+    switch (key) {
+    case ExecName:
+        return m_execNameIndex.values(value.toLower());
+    case ExecPath:
+        return m_execPathIndex.values(value.toLower());
+    case StartupWMClass:
+        return m_wmClassIndex.values(value.toLower());
+    case IconName:
+        return m_iconIndex.values(value.toLower());
+    case DesktopName:
+        return m_desktopNameIndex.values(value.toLower());
+    }
+
+    return QList<SystemAppItem *>();
+}
+
+QString SystemAppMonitor::desktopId(const QString &filePath, int *rank) const
+{
+    for (int i = 0; i < m_roots.size(); ++i) {
+        const QString &root = m_roots.at(i);
+
+        if (filePath.size() > root.size() && filePath.startsWith(root) && filePath.at(root.size()) == '/') {
+            if (rank)
+                *rank = i;
+
+            // Subdirectories are part of the id, e.g. kde4/foo.desktop is kde4-foo.desktop
+            return filePath.mid(root.size() + 1).replace('/', '-');
+        }
+    }
+
+    return QString();
+}
+
+QHash<QString, QString> SystemAppMonitor::resolveShadowing(const QHash<QString, EntryStat> &entries) const
+{
+    // The first folder providing a desktop id wins, the same id in
+    // lower folders is shadowed even if the winner is hidden.
+    QHash<QString, QString> winners;
+    QHash<QString, int> ranks;
 
-        if (!QFile::exists(filePath))
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+        int rank = 0;
+        const QString id = desktopId(it.key(), &rank);
+
+        if (id.isEmpty())
             continue;
 
-        allEntries.append(filePath);
+        auto best = ranks.constFind(id);
+
+        if (best == ranks.constEnd() || rank < best.value()
+                || (rank == best.value() && it.key() < winners.value(id))) {
+            ranks.insert(id, rank);
+            winners.insert(id, it.key());
+        }
     }
 
-    for (const QString &filePath : allEntries) {
-        if (!addedEntries.contains(filePath)) {
-            addApplication(filePath);
+    return winners;
+}
+
+bool SystemAppMonitor::scanDirectory(const QString &dir, QHash<QString, EntryStat> *entries)
+{
+    EntryStat dirStat;
+
+    if (!statEntry(dir, &dirStat))
+        return false;
+
+    m_dirStats.insert(dir, dirStat.mtime);
+
+    QDirIterator it(dir, { "*.desktop" }, QDir::AllDirs | QDir::Files | QDir::NoDotAndDotDot);
+
+    while (it.hasNext()) {
+        const QString &path = it.next();
+        const QFileInfo info = it.fileInfo();
+
+        if (info.isDir()) {
+            // Known ones have their own watch, symlinks may loop.
+            if (!info.isSymLink() && !m_dirStats.contains(path))
+                scanDirectory(path, entries);
+        } else {
+            EntryStat stat;
+
+            // Removed between listing and stat.
+            if (statEntry(path, &stat))
+                entries->insert(path, stat);
         }
     }
 
-    for (SystemAppItem *item : m_items) {
-        if (!allEntries.contains(item->path)) {
+    return true;
+}
+
+void SystemAppMonitor::rescanDirectory(const QString &dir, QHash<QString, EntryStat> *entries)
+{
+    const QString prefix = dir + '/';
+
+    // Forget what lived directly in it, listing it again brings back what is left.
+    for (auto it = entries->begin(); it != entries->end();) {
+        if (it.key().startsWith(prefix) && it.key().indexOf('/', prefix.size()) == -1)
+            it = entries->erase(it);
+        else
+            ++it;
+    }
+
+    // Subdirectories that went away take their whole tree with them.
+    const QStringList dirs = m_dirStats.keys();
+
+    for (const QString &subDir : dirs) {
+        if (subDir.startsWith(prefix) && subDir.indexOf('/', prefix.size()) == -1 && !QFileInfo::exists(subDir))
+            purgeDirectory(subDir, entries);
+    }
+
+    if (!scanDirectory(dir, entries)) {
+        purgeDirectory(dir, entries);
+
+        if (m_roots.contains(dir))
+            m_dirStats.insert(dir, 0);
+    }
+}
+
+void SystemAppMonitor::purgeDirectory(const QString &dir, QHash<QString, EntryStat> *entries)
+{
+    const QString prefix = dir + '/';
+
+    m_dirStats.remove(dir);
+
+    for (auto it = m_dirStats.begin(); it != m_dirStats.end();) {
+        if (it.key().startsWith(prefix))
+            it = m_dirStats.erase(it);
+        else
+            ++it;
+    }
+
+    for (auto it = entries->begin(); it != entries->end();) {
+        if (it.key().startsWith(prefix))
+            it = entries->erase(it);
+        else
+            ++it;
+    }
+}
+
+static QString existingAncestor(QString path)
+{
+    while (path != "/" && !QFileInfo(path).isDir())
+        path = QFileInfo(path).path();
+
+    return path;
+}
+
+void SystemAppMonitor::updateWatches()
+{
+    const QStringList watched = m_watcher->directories();
+    const QSet<QString> watchedSet(watched.cbegin(), watched.cend());
+    QSet<QString> wanted;
+    QStringList added;
+    QStringList removed;
+
+    m_anchors.clear();
+
+    for (auto it = m_dirStats.constBegin(); it != m_dirStats.constEnd(); ++it) {
+        // Missing roots are kept with a zero mtime, e.g. the user's or
+        // flatpak's folder before the first install.
+        if (it.value() != 0)
+            wanted.insert(it.key());
+        else if (m_roots.contains(it.key()))
+            m_anchors[existingAncestor(QFileInfo(it.key()).path())].append(it.key());
+    }
+
+    for (auto it = m_anchors.constBegin(); it != m_anchors.constEnd(); ++it)
+        wanted.insert(it.key());
+
+    for (const QString &dir : qAsConst(wanted)) {
+        if (!watchedSet.contains(dir))
+            added.append(dir);
+    }
+
+    for (const QString &dir : watched) {
+        if (!wanted.contains(dir))
+            removed.append(dir);
+    }
+
+    if (!removed.isEmpty())
+        m_watcher->removePaths(removed);
+
+    if (!added.isEmpty())
+        m_watcher->addPaths(added);
+}
+
+void SystemAppMonitor::refresh()
+{
+    QHash<QString, EntryStat> entries;
+    bool dirsChanged = true;
+
+    if (!m_dirtyDirs.isEmpty()) {
+        entries = m_entryStats;
+
+        for (const QString &dir : qAsConst(m_dirtyDirs))
+            rescanDirectory(dir, &entries);
+
+        m_dirtyDirs.clear();
+    } else if (directoriesChanged()) {
+        m_dirStats.clear();
+
+        for (const QString &root : qAsConst(m_roots)) {
+            if (!scanDirectory(root, &entries))
+                m_dirStats.insert(root, 0);
+        }
+    } else {
+        // No file can have been added or removed if no directory
+        // changed, only the known files need to be checked then.
+        dirsChanged = false;
+
+        for (auto it = m_entryStats.constBegin(); it != m_entryStats.constEnd(); ++it) {
+            EntryStat stat;
+
+            if (statEntry(it.key(), &stat))
+                entries.insert(it.key(), stat);
+        }
+    }
+
+    QStringList added;
+    QStringList removed;
+    QStringList changed;
+
+    // Files to parse, and those of them that had a visible item before.
+    QStringList pending;
+    QSet<QString> replaced;
+
+    const QHash<QString, QString> winners = resolveShadowing(entries);
+
+    for (auto it = winners.constBegin(); it != winners.constEnd(); ++it) {
+        const QString &filePath = it.value();
+        const QString oldPath = m_winners.value(it.key());
+
+        if (oldPath == filePath && m_entryStats.value(filePath) == entries.value(filePath))
+            continue;
+
+        if (SystemAppItem *item = find(oldPath)) {
             removeApplication(item);
+
+            if (oldPath == filePath)
+                replaced.insert(filePath);
+            else
+                removed.append(oldPath);
+        }
+
+        pending.append(filePath);
+    }
+
+    for (auto it = m_winners.constBegin(); it != m_winners.constEnd(); ++it) {
+        if (winners.contains(it.key()))
+            continue;
+
+        if (SystemAppItem *item = find(it.value())) {
+            removeApplication(item);
+            removed.append(it.value());
         }
     }
 
-    emit refreshed();
+    const bool indexChanged = dirsChanged || !pending.isEmpty() || entries.size() != m_entryStats.size();
+    m_entryStats = entries;
+    m_winners = winners;
+
+    // Merge on this thread in one go, a changed entry
+    // may also have become hidden or visible.
+    for (const ParsedEntry &entry : parseApplications(pending)) {
+        const bool wasVisible = replaced.contains(entry.path);
+
+        if (entry.visible) {
+            addApplication(entry);
+
+            if (wasVisible)
+                changed.append(entry.path);
+            else
+                added.append(entry.path);
+        } else if (wasVisible) {
+            removed.append(entry.path);
+        }
+    }
+
+    updateWatches();
+
+    if (indexChanged)
+        saveCache();
+
+    if (!added.isEmpty() || !removed.isEmpty() || !changed.isEmpty())
+        emit applicationsChanged(added, removed, changed);
 }
 
-void SystemAppMonitor::addApplication(const QString &filePath)
+bool SystemAppMonitor::directoriesChanged() const
 {
-    if (find(filePath))
-        return;
+    if (m_dirStats.isEmpty())
+        return true;
+
+    for (auto it = m_dirStats.constBegin(); it != m_dirStats.constEnd(); ++it) {
+        EntryStat stat;
+        const qint64 mtime = statEntry(it.key(), &stat) ? stat.mtime : 0;
 
-    QSettings desktop(filePath, QSettings::IniFormat);
-    desktop.beginGroup("Desktop Entry");
+        if (mtime != it.value())
+            return true;
+    }
 
-    if (desktop.value("Terminal").toBool())
+    return false;
+}
+
+void SystemAppMonitor::loadCache()
+{
+    QList<AppIndexCache::Record> records;
+
+    // A missing, stale or corrupt cache simply means a full rebuild.
+    if (!m_cache->load(&m_dirStats, &records))
         return;
 
-    if (desktop.contains("OnlyShowIn")) {
-        const QString &value = desktop.value("OnlyShowIn").toString();
-        if (!value.contains(detectDesktopEnvironment(), Qt::CaseInsensitive)) {
-            return;
+    for (const AppIndexCache::Record &record : qAsConst(records)) {
+        m_entryStats.insert(record.entry.path, record.stat);
+
+        if (record.entry.visible)
+            addApplication(record.entry);
+    }
+
+    m_winners = resolveShadowing(m_entryStats);
+}
+
+void SystemAppMonitor::saveCache()
+{
+    QList<AppIndexCache::Record> records;
+    records.reserve(m_entryStats.size());
+
+    for (auto it = m_entryStats.constBegin(); it != m_entryStats.constEnd(); ++it) {
+        AppIndexCache::Record record;
+        record.stat = it.value();
+        record.entry.path = it.key();
+
+        if (SystemAppItem *item = find(it.key())) {
+            record.entry.visible = true;
+            record.entry.name = item->name;
+            record.entry.genericName = item->genericName;
+            record.entry.comment = item->comment;
+            record.entry.iconName = item->iconName;
+            record.entry.startupWMClass = item->startupWMClass;
+            record.entry.exec = item->exec;
+            record.entry.argv = item->argv;
         }
+
+        records.append(record);
     }
 
-    if (desktop.value("NoDisplay").toBool() ||
-        desktop.value("Hidden").toBool()) {
-        return;
+    m_cache->save(m_dirStats, records);
+}
+
+QList<SystemAppMonitor::ParsedEntry> SystemAppMonitor::parseApplications(const QStringList &filePaths, bool parallel)
+{
+    // Not worth a round trip through the thread pool.
+    if (!parallel || filePaths.size() < 16) {
+        QList<ParsedEntry> entries;
+        entries.reserve(filePaths.size());
+
+        for (const QString &filePath : filePaths)
+            entries.append(parseApplication(filePath));
+
+        return entries;
+    }
+
+    return QtConcurrent::blockingMapped<QList<ParsedEntry>>(filePaths, &SystemAppMonitor::parseApplication);
+}
+
+SystemAppMonitor::ParsedEntry SystemAppMonitor::parseApplication(const QString &filePath)
+{
+    static const DesktopFileParser parser(QLocale::system().name());
+    static const QStringList desktops = currentDesktops();
+
+    ParsedEntry entry;
+    entry.path = filePath;
+
+    DesktopFileParser::Entry desktop;
+
+    if (!parser.parse(filePath, &desktop))
+        return entry;
+
+    if (desktop.terminal)
+        return entry;
+
+    if (!desktop.onlyShowIn.isEmpty()) {
+        bool show = false;
+
+        for (const QString &name : desktop.onlyShowIn)
+            show = show || desktops.contains(name, Qt::CaseInsensitive);
+
+        if (!show)
+            return entry;
     }
 
-    QString appName = desktop.value(QString("Name[%1]").arg(QLocale::system().name())).toString();
-    QString appExec = desktop.value("Exec").toString();
+    if (desktop.noDisplay || desktop.hidden)
+        return entry;
+
+    entry.visible = true;
+    entry.name = desktop.name;
+    entry.genericName = desktop.genericName;
+    entry.comment = desktop.comment;
+    entry.iconName = desktop.iconName;
+    entry.startupWMClass = desktop.startupWMClass;
+    entry.exec = DesktopFileParser::stripFieldCodes(desktop.exec);
+    entry.argv = DesktopFileParser::expandExec(DesktopFileParser::tokenizeExec(desktop.exec), QStringList(),
+                                               desktop.iconName, desktop.name, filePath);
 
-    if (appName.isEmpty())
-        appName = desktop.value("Name").toString();
+    return entry;
+}
 
-    appExec.remove(QRegularExpression("%."));
-    appExec.remove(QRegularExpression("^\""));
-    // appExec.remove(QRegularExpression(" *$"));
-    appExec = appExec.simplified();
+void SystemAppMonitor::addApplication(const ParsedEntry &entry)
+{
+    if (find(entry.path))
+        return;
 
     SystemAppItem *item = new SystemAppItem;
-    item->path = filePath;
-    item->name = appName;
-    item->genericName = desktop.value("GenericName").toString();
-    item->comment = desktop.value("Comment").toString();
-    item->iconName = desktop.value("Icon").toString();
-    item->startupWMClass = desktop.value("StartupWMClass").toString();
-    item->exec = appExec;
-    item->args = appExec.split(" ");
+    item->path = entry.path;
+    item->name = entry.name;
+    item->genericName = entry.genericName;
+    item->comment = entry.comment;
+    item->iconName = entry.iconName;
+    item->startupWMClass = entry.startupWMClass;
+    item->exec = entry.exec;
+    item->argv = entry.argv;
 
     m_items.append(item);
+    indexApplication(item);
 }
 
 void SystemAppMonitor::removeApplication(SystemAppItem *item)
 {
+    unindexApplication(item);
     m_items.removeOne(item);
     item->deleteLater();
 }
+
+void SystemAppMonitor::indexApplication(SystemAppItem *item)
+{
+    const QString program = item->argv.value(DesktopFileParser::programIndex(item->argv)).toLower();
+
+    m_pathIndex.insert(item->path, item);
+    m_desktopNameIndex.insert(QFileInfo(item->path).completeBaseName().toLower(), item);
+
+    if (!program.isEmpty()) {
+        m_execNameIndex.insert(QFileInfo(program).fileName(), item);
+
+        if (program.startsWith('/'))
+            m_execPathIndex.insert(program, item);
+    }
+
+    if (!item->startupWMClass.isEmpty())
+        m_wmClassIndex.insert(item->startupWMClass.toLower(), item);
+
+    if (!item->iconName.isEmpty())
+        m_iconIndex.insert(item->iconName.toLower(), item);
+}
+
+void SystemAppMonitor::unindexApplication(SystemAppItem *item)
+{
+    const QString program = item->argv.value(DesktopFileParser::programIndex(item->argv)).toLower();
+
+    m_pathIndex.remove(item->path);
+    m_desktopNameIndex.remove(QFileInfo(item->path).completeBaseName().toLower(), item);
+
+    if (!program.isEmpty()) {
+        m_execNameIndex.remove(QFileInfo(program).fileName(), item);
+
+        if (program.startsWith('/'))
+            m_execPathIndex.remove(program, item);
+    }
+
+    if (!item->startupWMClass.isEmpty())
+        m_wmClassIndex.remove(item->startupWMClass.toLower(), item);
+
+    if (!item->iconName.isEmpty())
+        m_iconIndex.remove(item->iconName.toLower(), item);
+}
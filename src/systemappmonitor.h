@@ -21,31 +21,133 @@
 #define SYSTEMAPPMONITOR_H
 
 #include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QTimer>
+#include <QFileSystemWatcher>
 #include "systemappitem.h"
 
+class AppIndexCache;
 class SystemAppMonitor : public QObject
 {
     Q_OBJECT
 
 public:
+    struct EntryStat {
+        qint64 mtime = 0;
+        qint64 size = 0;
+        quint64 inode = 0;
+
+        bool operator==(const EntryStat &other) const {
+            return mtime == other.mtime && size == other.size && inode == other.inode;
+        }
+        bool operator!=(const EntryStat &other) const { return !(*this == other); }
+    };
+
+    // Result of parsing one .desktop file, filled on worker threads.
+    struct ParsedEntry {
+        QString path;
+        QString name;
+        QString genericName;
+        QString comment;
+        QString iconName;
+        QString startupWMClass;
+        QString exec;
+        QStringList argv;
+        bool visible = false;
+    };
+
+    // Secondary indexes, see candidates().
+    enum IndexKey {
+        ExecName,
+        ExecPath,
+        StartupWMClass,
+        IconName,
+        DesktopName
+    };
+
     static SystemAppMonitor *self();
 
     explicit SystemAppMonitor(QObject *parent = nullptr);
     ~SystemAppMonitor();
 
     SystemAppItem *find(const QString &filePath);
+    SystemAppItem *findByExecName(const QString &name);
+    SystemAppItem *findByExecPath(const QString &path);
+    SystemAppItem *findByStartupWMClass(const QString &wmClass);
+    SystemAppItem *findByIconName(const QString &iconName);
+    SystemAppItem *findByDesktopName(const QString &name);
+    SystemAppItem *findByDesktopId(const QString &desktopId);
+    QList<SystemAppItem *> candidates(IndexKey key, const QString &value) const;
+
     QList<SystemAppItem *> applications() { return m_items; }
 
+    // Whether the folder holding filePath has been listed, contains()
+    // then answers for it without touching the disk.
+    bool covers(const QString &filePath) const;
+    // Any entry found there, including the ones that are not shown.
+    bool contains(const QString &filePath) const;
+
+    // On the global thread pool unless parallel is false, which is only
+    // there to compare against.
+    static QList<ParsedEntry> parseApplications(const QStringList &filePaths, bool parallel = true);
+
 signals:
-    void refreshed();
+    void applicationsChanged(const QStringList &added,
+                             const QStringList &removed,
+                             const QStringList &changed);
 
 private:
+    static bool statEntry(const QString &filePath, EntryStat *entry);
+    static ParsedEntry parseApplication(const QString &filePath);
+
+    QString desktopId(const QString &filePath, int *rank = nullptr) const;
+    QHash<QString, QString> resolveShadowing(const QHash<QString, EntryStat> &entries) const;
+
+    bool scanDirectory(const QString &dir, QHash<QString, EntryStat> *entries);
+    void rescanDirectory(const QString &dir, QHash<QString, EntryStat> *entries);
+    void purgeDirectory(const QString &dir, QHash<QString, EntryStat> *entries);
+    void updateWatches();
+
+    bool directoriesChanged() const;
+    void loadCache();
+    void saveCache();
+
     void refresh();
-    void addApplication(const QString &filePath);
+    void addApplication(const ParsedEntry &entry);
     void removeApplication(SystemAppItem *item);
 
+    void indexApplication(SystemAppItem *item);
+    void unindexApplication(SystemAppItem *item);
+
 private:
     QList<SystemAppItem *> m_items;
+
+    // Every scanned .desktop file, including the ones that were skipped,
+    // so that unchanged entries are never parsed twice.
+    QHash<QString, EntryStat> m_entryStats;
+    // Desktop id to the file providing it, after shadowing.
+    QHash<QString, QString> m_winners;
+
+    // Applications folders in precedence order.
+    QStringList m_roots;
+    // Modification time of every scanned directory.
+    QHash<QString, qint64> m_dirStats;
+    QSet<QString> m_dirtyDirs;
+    // Closest existing folder above missing roots, watched in their place.
+    QHash<QString, QStringList> m_anchors;
+    QFileSystemWatcher *m_watcher;
+    QTimer *m_refreshTimer;
+    AppIndexCache *m_cache;
+
+    // Secondary indexes used to resolve windows to desktop entries,
+    // all keys except the path are lowercased.
+    QHash<QString, SystemAppItem *> m_pathIndex;
+    QMultiHash<QString, SystemAppItem *> m_execNameIndex;
+    QMultiHash<QString, SystemAppItem *> m_execPathIndex;
+    QMultiHash<QString, SystemAppItem *> m_wmClassIndex;
+    QMultiHash<QString, SystemAppItem *> m_iconIndex;
+    QMultiHash<QString, SystemAppItem *> m_desktopNameIndex;
 };
 
 #endif // SYSTEMAPPMONITOR_H
@@ -18,8 +18,10 @@
  */
 
 #include "utils.h"
+#include "desktopfileparser.h"
 #include "systemappmonitor.h"
 #include "systemappitem.h"
+#include "processinfocache.h"
 
 #include <QFile>
 #include <QFileInfo>
@@ -31,6 +33,16 @@
 
 static Utils *INSTANCE = nullptr;
 
+// A window match at least this good beats the owner's cgroup, weaker
+// ones only count when nothing else is found.
+static const int StrongScore = 50;
+// Parent processes only count by their Exec, never by icon.
+static const int ParentScore = 40;
+// Launcher wrappers and zygotes rarely nest deeper than this.
+static const int MaxParentDepth = 4;
+// How far up the same unit to look for the process that owns it.
+static const int MaxUnitDepth = 8;
+
 Utils *Utils::instance()
 {
     if (!INSTANCE)
@@ -43,130 +55,305 @@ Utils::Utils(QObject *parent)
     : QObject(parent)
     , m_sysAppMonitor(SystemAppMonitor::self())
 {
+    connect(m_sysAppMonitor, &SystemAppMonitor::applicationsChanged, this, [=] {
+        m_matchCache.clear();
+    });
+}
+
+// ref: https://github.com/KDE/kcoreaddons/blob/230c98aa7e01f9e36a9c2776f3633182e6778002/src/lib/util/kprocesslist_unix.cpp#L137
+static QStringList commandFromInfo(const ProcessInfoCache::Info *info)
+{
+    if (!info || info->argv.isEmpty())
+        return QStringList();
 
+    // Some programs rewrite their cmdline as a single string with spaces.
+    QString command = info->argv.first();
+    const int space = command.indexOf(' ');
+
+    if (space != -1)
+        command.truncate(space);
+
+    // extract non-truncated name from cmdline
+    const QString name = command.mid(command.lastIndexOf('/') + 1);
+
+    return { command, name };
 }
 
 QStringList Utils::commandFromPid(quint32 pid)
 {
-    QFile file(QString("/proc/%1/cmdline").arg(pid));
-
-    if (file.open(QIODevice::ReadOnly)) {
-        QByteArray cmd = file.readAll();
-
-        // ref: https://github.com/KDE/kcoreaddons/blob/230c98aa7e01f9e36a9c2776f3633182e6778002/src/lib/util/kprocesslist_unix.cpp#L137
-        if (!cmd.isEmpty()) {
-            // extract non-truncated name from cmdline
-            int zeroIndex = cmd.indexOf('\0');
-            int processNameStart = cmd.lastIndexOf('/', zeroIndex);
-            if (processNameStart == -1) {
-                processNameStart = 0;
-            } else {
-                processNameStart++;
-            }
+    return commandFromInfo(ProcessInfoCache::self()->info(pid));
+}
+
+QString Utils::desktopPathFromMetadata(const QString &appId, quint32 pid, const QString &xWindowWMClassName)
+{
+    return resolveDesktop(appId, pid, xWindowWMClassName).path;
+}
+
+Utils::DesktopMatch Utils::resolveDesktop(const QString &appId, quint32 pid, const QString &xWindowWMClassName)
+{
+    ProcessInfoCache *processes = ProcessInfoCache::self();
+    const ProcessInfoCache::Info *found = processes->info(pid);
+
+    if (!found)
+        return DesktopMatch();
 
-            QString name = QString::fromLocal8Bit(cmd.mid(processNameStart, zeroIndex - processNameStart));
+    // Copied, the cache may rehash on the parent lookups below.
+    const ProcessInfoCache::Info info = *found;
+    QStringList commands = commandFromInfo(&info);
 
-            // reion: Remove parameters
-            name = name.split(' ').first();
+    // Interpreters and wrappers are better told apart by their binary.
+    const DesktopMatch window = matchWindow(appId, xWindowWMClassName, commands.value(0), info.exe);
 
-            cmd.replace('\0', ' ');
-            QString command = QString::fromLocal8Bit(cmd).trimmed();
+    if (window.score >= StrongScore)
+        return window;
 
-            // There may be parameters.
-            if (command.split(' ').size() > 1) {
-                command = command.split(' ').first();
+    // Launched through systemd, the scope names the desktop id. Children
+    // inherit it though, e.g. programs started from a terminal.
+    DesktopMatch match;
+    match.path = matchUnit(info.unit);
+
+    if (!match.path.isEmpty()
+            && (!inheritsUnit(info) || unitFitsWindow(match.path, appId, xWindowWMClassName, commands.value(1), info.exe))) {
+        match.stage = CgroupMatch;
+        return match;
+    }
+
+    if (!window.path.isEmpty())
+        return window;
+
+    // Helpers, interpreters and flatpak-spawn children: look for the
+    // process that was started from the desktop file. Stop at anything
+    // that has windows of its own, e.g. a terminal or a launcher.
+    quint32 ppid = info.ppid;
+
+    for (int depth = 0; depth < MaxParentDepth && ppid > 1; ++depth) {
+        if (processes->hasWindows(ppid))
+            break;
+
+        found = processes->info(ppid);
+
+        if (!found)
+            break;
+
+        const ProcessInfoCache::Info parent = *found;
+        commands = commandFromInfo(&parent);
+
+        if (!commands.isEmpty()) {
+            match = matchDesktopPath(QString(), QString(), commands.first(), commands.last(), parent.exe);
+
+            if (match.score >= ParentScore) {
+                match.stage = ParentMatch;
+                return match;
             }
+        }
+
+        if (parent.unit != info.unit) {
+            match.path = matchUnit(parent.unit);
 
-            return { command, name };
+            if (!match.path.isEmpty()) {
+                match.stage = ParentMatch;
+                match.score = 0;
+                return match;
+            }
         }
+
+        ppid = parent.ppid;
     }
 
-    return QStringList();
+    return DesktopMatch();
 }
 
-QString Utils::desktopPathFromMetadata(const QString &appId, quint32 pid, const QString &xWindowWMClassName)
+// Whether a process further up in the same unit has windows, so the
+// unit most likely belongs to that one.
+bool Utils::inheritsUnit(const ProcessInfoCache::Info &info) const
+{
+    ProcessInfoCache *processes = ProcessInfoCache::self();
+    quint32 ppid = info.ppid;
+
+    for (int depth = 0; depth < MaxUnitDepth && ppid > 1; ++depth) {
+        const ProcessInfoCache::Info *parent = processes->info(ppid);
+
+        if (!parent || parent->unit != info.unit)
+            break;
+
+        if (processes->hasWindows(ppid))
+            return true;
+
+        ppid = parent->ppid;
+    }
+
+    return false;
+}
+
+// Whether the entry could plausibly have mapped the window, by class,
+// desktop file name or program.
+bool Utils::unitFitsWindow(const QString &desktopPath, const QString &windowClass, const QString &instanceName,
+                           const QString &commandName, const QString &exe) const
 {
-    QStringList commands = commandFromPid(pid);
+    SystemAppItem *app = m_sysAppMonitor->find(desktopPath);
 
-    // The value returned from the commandFromPid() may be empty.
-    // Calling first() and last() below will cause the statusbar to crash.
-    if (commands.isEmpty() || xWindowWMClassName.isEmpty())
-        return "";
+    if (!app)
+        return false;
 
-    QString command = commands.first();
-    QString commandName = commands.last();
+    const QString desktopName = QFileInfo(desktopPath).completeBaseName();
+    const QString program = QFileInfo(app->argv.value(DesktopFileParser::programIndex(app->argv))).fileName();
+    const QStringList names { windowClass, instanceName, commandName, QFileInfo(exe).fileName() };
 
-    if (command.isEmpty())
-        return "";
+    for (const QString &name : names) {
+        if (name.isEmpty())
+            continue;
 
-    QString result;
+        if (name.compare(app->startupWMClass, Qt::CaseInsensitive) == 0
+                || name.compare(desktopName, Qt::CaseInsensitive) == 0
+                || desktopName.endsWith('.' + name, Qt::CaseInsensitive)
+                || name.compare(program, Qt::CaseInsensitive) == 0)
+            return true;
+    }
 
-    if (!appId.isEmpty() && !xWindowWMClassName.isEmpty()) {
-        for (SystemAppItem *item : m_sysAppMonitor->applications()) {
-            // Start search.
-            const QFileInfo desktopFileInfo(item->path);
+    return false;
+}
 
-            bool isExecPath = QFile::exists(item->exec);
-            bool founded = false;
+Utils::DesktopMatch Utils::matchWindow(const QString &appId, const QString &xWindowWMClassName,
+                                      const QString &command, const QString &exe)
+{
+    if (command.isEmpty() || appId.isEmpty() || xWindowWMClassName.isEmpty())
+        return DesktopMatch();
 
-            if (item->exec == command || item->exec == commandName) {
-                founded = true;
-            }
+    // Applications keep mapping windows with the same class from the
+    // same binary, resolve each combination only once.
+    const QString key = appId + '\n' + xWindowWMClassName + '\n' + command + '\n' + exe;
+    auto cached = m_matchCache.constFind(key);
 
-            // StartupWMClass=STRING
-            // If true, it is KNOWN that the application will map at least one
-            // window with the given string as its WM class or WM name hint.
-            // ref: https://specifications.freedesktop.org/startup-notification-spec/startup-notification-0.1.txt
-            if (item->startupWMClass.startsWith(appId, Qt::CaseInsensitive) ||
-                item->startupWMClass.startsWith(xWindowWMClassName, Qt::CaseInsensitive))
-                founded = true;
+    if (cached != m_matchCache.constEnd())
+        return cached.value();
 
-            if (!founded && item->iconName.startsWith(xWindowWMClassName, Qt::CaseInsensitive))
-                founded = true;
+    const QString commandName = command.mid(command.lastIndexOf('/') + 1);
+    const DesktopMatch window = matchDesktopPath(appId, xWindowWMClassName, command, commandName, exe);
+    m_matchCache.insert(key, window);
 
-            // Icon name and cmdline.
-            if (!founded && (item->iconName == command || item->iconName == commandName))
-                founded = true;
+    return window;
+}
 
-            // Exec name and cmdline.
-            if (!founded && (item->exec == command || item->exec == commandName))
-                founded = true;
+// ref: https://systemd.io/DESKTOP_ENVIRONMENTS/
+// app[-<launcher>]-<ApplicationID>[@<RANDOM>].service
+// app[-<launcher>]-<ApplicationID>-<RANDOM>.scope
+QString Utils::matchUnit(const QString &unit)
+{
+    if (!unit.startsWith(QLatin1String("app-")))
+        return QString();
 
-            // Try matching mapped name against 'Name'.
-            if (!founded && item->name.startsWith(xWindowWMClassName, Qt::CaseInsensitive))
-                founded = true;
+    QString name;
 
-            // exec
-            if (!founded && item->exec.startsWith(xWindowWMClassName, Qt::CaseInsensitive))
-                founded = true;
+    if (unit.endsWith(QLatin1String(".scope"))) {
+        name = unit.mid(4, unit.size() - 4 - 6);
+        name.truncate(qMax(0, name.lastIndexOf('-')));
+    } else if (unit.endsWith(QLatin1String(".service"))) {
+        name = unit.mid(4, unit.size() - 4 - 8);
+        const int at = name.indexOf('@');
 
-            if (!founded && desktopFileInfo.baseName().startsWith(xWindowWMClassName, Qt::CaseInsensitive))
-                founded = true;
+        if (at != -1)
+            name.truncate(at);
+    }
 
-            // For exec path.
-            if (isExecPath && !founded && (command.contains(item->exec) || commandName.contains(item->exec))) {
-                founded = true;
-            }
+    if (name.isEmpty())
+        return QString();
 
-            if (founded) {
-                result = item->path;
-                break;
-            }
+    // Dashes inside the id are escaped as \x2d, so the only literal
+    // one left separates the optional launcher name.
+    QStringList ids;
+    const int dash = name.indexOf('-');
+
+    if (dash != -1)
+        ids << name.mid(dash + 1);
+    ids << name;
+
+    for (QString id : qAsConst(ids)) {
+        for (int i = id.indexOf(QLatin1String("\\x")); i != -1; i = id.indexOf(QLatin1String("\\x"), i + 1)) {
+            bool ok = false;
+            const ushort c = id.mid(i + 2, 2).toUShort(&ok, 16);
+
+            if (ok)
+                id.replace(i, 4, QChar(c));
+        }
+
+        if (SystemAppItem *item = m_sysAppMonitor->findByDesktopId(id + ".desktop"))
+            return item->path;
+    }
+
+    return QString();
+}
+
+Utils::DesktopMatch Utils::matchDesktopPath(const QString &windowClass, const QString &instanceName,
+                                const QString &command, const QString &commandName,
+                                const QString &exe)
+{
+    QHash<SystemAppItem *, int> scores;
+
+    auto score = [&] (SystemAppMonitor::IndexKey key, const QString &value, int weight) {
+        if (value.isEmpty())
+            return;
+
+        for (SystemAppItem *item : m_sysAppMonitor->candidates(key, value))
+            scores[item] += weight;
+    };
+
+    // StartupWMClass=STRING
+    // If true, it is KNOWN that the application will map at least one
+    // window with the given string as its WM class or WM name hint.
+    // ref: https://specifications.freedesktop.org/startup-notification-spec/startup-notification-0.1.txt
+    score(SystemAppMonitor::StartupWMClass, windowClass, 100);
+    score(SystemAppMonitor::StartupWMClass, instanceName, 100);
+
+    // Desktop file named after the window class, e.g. org.gnome.Nautilus.
+    score(SystemAppMonitor::DesktopName, windowClass, 60);
+    score(SystemAppMonitor::DesktopName, instanceName, 60);
+
+    // Exec against the running binary.
+    if (command.startsWith('/'))
+        score(SystemAppMonitor::ExecPath, command, 50);
+    else if (!exe.isEmpty())
+        score(SystemAppMonitor::ExecPath, exe, 50);
+
+    score(SystemAppMonitor::ExecName, commandName, 40);
+    score(SystemAppMonitor::ExecName, instanceName, 20);
+
+    // Icon named after the window class or the binary.
+    score(SystemAppMonitor::IconName, instanceName, 20);
+    score(SystemAppMonitor::IconName, windowClass, 20);
+    score(SystemAppMonitor::IconName, commandName, 10);
+
+    SystemAppItem *best = nullptr;
+    int bestScore = 0;
+
+    // Ties go to the smallest path, so that the result does not
+    // depend on the iteration order.
+    for (auto it = scores.constBegin(); it != scores.constEnd(); ++it) {
+        if (it.value() > bestScore || (it.value() == bestScore && it.key()->path < best->path)) {
+            best = it.key();
+            bestScore = it.value();
         }
     }
 
-    return result;
+    DesktopMatch match;
+
+    if (best) {
+        match.path = best->path;
+        match.stage = WindowMatch;
+        match.score = bestScore;
+    }
+
+    return match;
 }
 
 QMap<QString, QString> Utils::readInfoFromDesktop(const QString &desktopFile)
 {
     QMap<QString, QString> info;
-    for (SystemAppItem *item : m_sysAppMonitor->applications()) {
-        if (item->path == desktopFile) {
-            info.insert("Icon", item->iconName);
-            info.insert("Name", item->name);
-            info.insert("Exec", item->exec);
-        }
+    SystemAppItem *item = m_sysAppMonitor->find(desktopFile);
+
+    if (item) {
+        info.insert("Icon", item->iconName);
+        info.insert("Name", item->name);
+        info.insert("Exec", item->exec);
     }
 
     return info;
@@ -21,9 +21,12 @@
 #define UTILS_H
 
 #include <QObject>
+#include <QHash>
 #include <QIcon>
 #include <QUrl>
 
+#include "processinfocache.h"
+
 class SystemAppMonitor;
 class Utils : public QObject
 {
@@ -45,6 +48,22 @@ public:
          IgnoreQueryItems
     };
 
+    // Which resolver stage attributed a window to its desktop file.
+    enum MatchStage {
+        NoMatch = 0,
+        WindowMatch,    // window class and the owner's command line
+        CgroupMatch,    // systemd app-*.scope / app-*.service of the owner
+        ParentMatch     // command line or cgroup of a parent process
+    };
+    Q_ENUM(MatchStage)
+
+    struct DesktopMatch
+    {
+        QString path;
+        MatchStage stage = NoMatch;
+        int score = 0;
+    };
+
     static Utils *instance();
 
     explicit Utils(QObject *parent = nullptr);
@@ -52,10 +71,28 @@ public:
     QStringList commandFromPid(quint32 pid);
     QString desktopPathFromMetadata(const QString &appId, quint32 pid = 0,
                                     const QString &xWindowWMClassName = QString());
+    DesktopMatch resolveDesktop(const QString &appId, quint32 pid = 0,
+                                const QString &xWindowWMClassName = QString());
+    // The window stage alone, for windows without a process to look at.
+    DesktopMatch matchWindow(const QString &appId, const QString &xWindowWMClassName,
+                             const QString &command, const QString &exe = QString());
     QMap<QString, QString> readInfoFromDesktop(const QString &desktopFile);
 
+private:
+    DesktopMatch matchDesktopPath(const QString &windowClass, const QString &instanceName,
+                                  const QString &command, const QString &commandName,
+                                  const QString &exe);
+    QString matchUnit(const QString &unit);
+    bool inheritsUnit(const ProcessInfoCache::Info &info) const;
+    bool unitFitsWindow(const QString &desktopPath, const QString &windowClass, const QString &instanceName,
+                        const QString &commandName, const QString &exe) const;
+
 private:
     SystemAppMonitor *m_sysAppMonitor;
+
+    // (class, instance, command, exe) to desktop file, cleared whenever
+    // the installed applications change.
+    QHash<QString, DesktopMatch> m_matchCache;
 };
 
 #endif // UTILS_H
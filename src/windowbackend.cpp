@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "windowbackend.h"
+#include "xwindowinterface.h"
+#include "syntheticbackend.h"
+
+#include <QUuid>
+
+#include <KWindowEffects>
+
+static WindowBackend *SELF = nullptr;
+
+WindowBackend *WindowBackend::self()
+{
+    if (!SELF) {
+        if (qEnvironmentVariable("LINGMO_DOCK_BACKEND") == QLatin1String("synthetic"))
+            SELF = new SyntheticBackend;
+        else
+            SELF = new XWindowInterface;
+    }
+
+    return SELF;
+}
+
+WindowBackend::WindowBackend(QObject *parent)
+    : QObject(parent)
+{
+}
+
+QMap<QString, QVariant> WindowBackend::requestInfo(quint64 wid)
+{
+    const WindowProperties info = properties(wid);
+    QMap<QString, QVariant> result;
+    const QString winClass = QString(info.windowClass);
+
+    result.insert("iconName", winClass.toLower());
+    result.insert("active", wid == activeWindow());
+    result.insert("visibleName", info.name);
+    result.insert("id", winClass);
+
+    return result;
+}
+
+QString WindowBackend::requestWindowClass(quint64 wid)
+{
+    return properties(wid).windowClass;
+}
+
+bool WindowBackend::isAcceptableWindow(quint64 wid)
+{
+    return isAcceptable(wid, properties(wid));
+}
+
+bool WindowBackend::isAcceptable(quint64 wid, const WindowProperties &properties) const
+{
+    QFlags<NET::WindowTypeMask> ignoreList;
+    ignoreList |= NET::DesktopMask;
+    ignoreList |= NET::DockMask;
+    ignoreList |= NET::SplashMask;
+    ignoreList |= NET::ToolbarMask;
+    ignoreList |= NET::MenuMask;
+    ignoreList |= NET::PopupMenuMask;
+    ignoreList |= NET::NotificationMask;
+
+    if (!properties.valid)
+        return false;
+
+    if (NET::typeMatchesMask(properties.type, ignoreList))
+        return false;
+
+    if (properties.state & (NET::SkipTaskbar | NET::SkipPager))
+        return false;
+
+    // WM_TRANSIENT_FOR hint not set - normal window
+    const quint64 transFor = properties.transientFor;
+    if (transFor == 0 || transFor == wid)
+        return true;
+
+    QFlags<NET::WindowTypeMask> normalFlag;
+    normalFlag |= NET::NormalMask;
+    normalFlag |= NET::DialogMask;
+    normalFlag |= NET::UtilityMask;
+
+    return !NET::typeMatchesMask(properties.transientForType, normalFlag);
+}
+
+void WindowBackend::setIconGeometries(const QHash<quint64, QRect> &geometries)
+{
+    for (auto it = geometries.constBegin(); it != geometries.constEnd(); ++it)
+        setIconGeometry(it.key(), it.value());
+}
+
+void WindowBackend::enableBlurBehind(QWindow *view, bool enable, const QRegion &region)
+{
+    KWindowEffects::enableBlurBehind(view, enable, region);
+}
+
+void WindowBackend::setViewStruts(QWindow *view, DockSettings::Direction direction, const QRect &rect, bool compositing)
+{
+    Q_UNUSED(view)
+    Q_UNUSED(direction)
+    Q_UNUSED(rect)
+    Q_UNUSED(compositing)
+}
+
+void WindowBackend::clearViewStruts(QWindow *view)
+{
+    Q_UNUSED(view)
+}
+
+QByteArray WindowBackend::createStartupId()
+{
+    return QUuid::createUuid().toByteArray(QUuid::WithoutBraces);
+}
+
+void WindowBackend::sendStartup(const QByteArray &id, const QString &name, const QString &iconName,
+                                const QString &desktopPath, const QString &bin)
+{
+    Q_UNUSED(id)
+    Q_UNUSED(name)
+    Q_UNUSED(iconName)
+    Q_UNUSED(desktopPath)
+    Q_UNUSED(bin)
+}
+
+void WindowBackend::sendStartupFinished(const QByteArray &id)
+{
+    Q_UNUSED(id)
+}
+
+QByteArray WindowBackend::startupId(quint64 wid)
+{
+    return properties(wid).startupId;
+}
+
+QVariantMap WindowBackend::cacheStats() const
+{
+    return QVariantMap();
+}
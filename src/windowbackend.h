@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WINDOWBACKEND_H
+#define WINDOWBACKEND_H
+
+#include "docksettings.h"
+
+#include <QObject>
+#include <QMap>
+#include <QRect>
+#include <QRegion>
+#include <QVariant>
+#include <QWindow>
+
+#include <netwm_def.h>
+
+// The window system as seen by the dock. XWindowInterface talks to the
+// X server, SyntheticBackend makes up windows in process so that the
+// model can be driven without one (LINGMO_DOCK_BACKEND=synthetic).
+class WindowBackend : public QObject
+{
+    Q_OBJECT
+
+public:
+    // What the dock reads from a client window.
+    struct WindowProperties
+    {
+        bool valid = false;
+        NET::WindowType type = NET::Unknown;
+        NET::States state;
+        QByteArray windowClass;
+        QByteArray instanceName;
+        // _NET_WM_VISIBLE_NAME, _NET_WM_NAME or WM_NAME
+        QString name;
+        quint32 pid = 0;
+        // 0 when unset or transient for the root window.
+        quint64 transientFor = 0;
+        // Type of the transientFor window, if any.
+        NET::WindowType transientForType = NET::Unknown;
+        int desktop = 0;
+        QByteArray startupId;
+    };
+
+    static WindowBackend *self();
+    explicit WindowBackend(QObject *parent = nullptr);
+
+    virtual QList<quint64> windows() = 0;
+    virtual WId activeWindow() = 0;
+    virtual WindowProperties properties(quint64 wid) = 0;
+    virtual QString desktopFilePath(quint64 wid) = 0;
+
+    // Announces the windows that already exist through windowsAdded().
+    virtual void startInitWindows() = 0;
+
+    virtual void forceActiveWindow(WId win) = 0;
+    virtual void minimizeWindow(WId win) = 0;
+    virtual void closeWindow(WId win) = 0;
+    virtual void setIconGeometry(quint64 wid, const QRect &rect) = 0;
+    // All in one go, as far as the window system allows.
+    virtual void setIconGeometries(const QHash<quint64, QRect> &geometries);
+
+    QMap<QString, QVariant> requestInfo(quint64 wid);
+    QString requestWindowClass(quint64 wid);
+    bool isAcceptableWindow(quint64 wid);
+
+    // The dock's own window.
+    virtual void enableBlurBehind(QWindow *view, bool enable = true, const QRegion &region = QRegion());
+    virtual void setViewStruts(QWindow *view, DockSettings::Direction direction, const QRect &rect, bool compositing = false);
+    virtual void clearViewStruts(QWindow *view);
+
+    // Startup notification, ref: https://specifications.freedesktop.org/startup-notification-spec/
+    virtual QByteArray createStartupId();
+    virtual void sendStartup(const QByteArray &id, const QString &name, const QString &iconName,
+                             const QString &desktopPath, const QString &bin);
+    virtual void sendStartupFinished(const QByteArray &id);
+    virtual QByteArray startupId(quint64 wid);
+
+    virtual QVariantMap cacheStats() const;
+
+signals:
+    void windowAdded(quint64 wid);
+    void windowRemoved(quint64 wid);
+    void windowChanged(quint64 wid);
+    void activeChanged(quint64 wid);
+    void startupFinished(const QByteArray &id);
+    // Windows that already existed when the dock started.
+    void windowsAdded(const QList<quint64> &wids);
+
+protected:
+    bool isAcceptable(quint64 wid, const WindowProperties &properties) const;
+};
+
+#endif // WINDOWBACKEND_H
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "windowtrace.h"
+
+#include <QCoreApplication>
+
+static const quint32 TraceMagic = 0x4c445754; // "LDWT"
+static const quint32 TraceVersion = 1;
+
+// Recording must not cost a write per event.
+static const int FlushInterval = 256;
+
+static QDataStream &operator<<(QDataStream &out, const WindowBackend::WindowProperties &properties)
+{
+    out << properties.valid
+        << qint32(properties.type)
+        << qint32(properties.state.toInt())
+        << properties.windowClass
+        << properties.instanceName
+        << properties.name
+        << properties.pid
+        << properties.transientFor
+        << qint32(properties.transientForType)
+        << qint32(properties.desktop)
+        << properties.startupId;
+    return out;
+}
+
+static QDataStream &operator>>(QDataStream &in, WindowBackend::WindowProperties &properties)
+{
+    qint32 type = 0;
+    qint32 state = 0;
+    qint32 transientForType = 0;
+    qint32 desktop = 0;
+
+    in >> properties.valid
+       >> type
+       >> state
+       >> properties.windowClass
+       >> properties.instanceName
+       >> properties.name
+       >> properties.pid
+       >> properties.transientFor
+       >> transientForType
+       >> desktop
+       >> properties.startupId;
+
+    properties.type = NET::WindowType(type);
+    properties.state = NET::States::fromInt(state);
+    properties.transientForType = NET::WindowType(transientForType);
+    properties.desktop = desktop;
+    return in;
+}
+
+WindowTraceWriter *WindowTraceWriter::fromEnvironment()
+{
+    const QString fileName = qEnvironmentVariable("LINGMO_DOCK_TRACE");
+
+    if (fileName.isEmpty())
+        return nullptr;
+
+    WindowTraceWriter *writer = new WindowTraceWriter(fileName);
+
+    if (!writer->isOpen()) {
+        delete writer;
+        return nullptr;
+    }
+
+    return writer;
+}
+
+WindowTraceWriter::WindowTraceWriter(const QString &fileName)
+    : m_file(fileName)
+    , m_unflushed(0)
+{
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return;
+
+    m_out.setDevice(&m_file);
+    m_out.setVersion(QDataStream::Qt_6_0);
+    m_out << TraceMagic << TraceVersion;
+    m_clock.start();
+
+    QObject::connect(qApp, &QCoreApplication::aboutToQuit, qApp, [=] { flush(); });
+}
+
+bool WindowTraceWriter::isOpen() const
+{
+    return m_file.isOpen();
+}
+
+void WindowTraceWriter::record(WindowTrace::EventType type, quint64 wid,
+                               const WindowBackend::WindowProperties &properties)
+{
+    if (!m_file.isOpen())
+        return;
+
+    m_out << qint64(m_clock.nsecsElapsed() / 1000) << quint8(type) << wid;
+
+    if (type == WindowTrace::Added || type == WindowTrace::Changed)
+        m_out << properties;
+
+    if (++m_unflushed >= FlushInterval)
+        flush();
+}
+
+void WindowTraceWriter::flush()
+{
+    m_unflushed = 0;
+    m_file.flush();
+}
+
+WindowTraceReader::WindowTraceReader(const QString &fileName)
+    : m_file(fileName)
+    , m_valid(false)
+{
+    if (!m_file.open(QIODevice::ReadOnly))
+        return;
+
+    quint32 magic = 0;
+    quint32 version = 0;
+
+    m_in.setDevice(&m_file);
+    m_in.setVersion(QDataStream::Qt_6_0);
+    m_in >> magic >> version;
+
+    m_valid = m_in.status() == QDataStream::Ok && magic == TraceMagic && version == TraceVersion;
+}
+
+bool WindowTraceReader::isOpen() const
+{
+    return m_valid;
+}
+
+bool WindowTraceReader::atEnd() const
+{
+    return !m_valid || m_in.atEnd();
+}
+
+bool WindowTraceReader::next(WindowTrace::Event *event)
+{
+    if (atEnd())
+        return false;
+
+    quint8 type = 0;
+
+    m_in >> event->time >> type >> event->wid;
+    event->type = WindowTrace::EventType(type);
+    event->properties = WindowBackend::WindowProperties();
+
+    if (event->type == WindowTrace::Added || event->type == WindowTrace::Changed)
+        m_in >> event->properties;
+
+    // A recording cut short by a crash ends with a partial event.
+    if (m_in.status() != QDataStream::Ok) {
+        m_valid = false;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WINDOWTRACE_H
+#define WINDOWTRACE_H
+
+#include "windowbackend.h"
+
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+
+// Window events as the backend saw them, with the properties of the
+// window at that time, for replaying real sessions offline.
+namespace WindowTrace
+{
+    enum EventType : quint8 {
+        Added = 0,
+        Removed,
+        Changed,
+        Activated
+    };
+
+    struct Event
+    {
+        // Microseconds since the start of the recording.
+        qint64 time = 0;
+        EventType type = Added;
+        quint64 wid = 0;
+        // Only for Added and Changed.
+        WindowBackend::WindowProperties properties;
+    };
+}
+
+class WindowTraceWriter
+{
+public:
+    // Records to the file named by LINGMO_DOCK_TRACE, nullptr if unset.
+    static WindowTraceWriter *fromEnvironment();
+
+    explicit WindowTraceWriter(const QString &fileName);
+
+    bool isOpen() const;
+
+    void record(WindowTrace::EventType type, quint64 wid,
+                const WindowBackend::WindowProperties &properties = WindowBackend::WindowProperties());
+    void flush();
+
+private:
+    QFile m_file;
+    QDataStream m_out;
+    QElapsedTimer m_clock;
+    int m_unflushed;
+};
+
+class WindowTraceReader
+{
+public:
+    explicit WindowTraceReader(const QString &fileName);
+
+    bool isOpen() const;
+    bool atEnd() const;
+    bool next(WindowTrace::Event *event);
+
+private:
+    QFile m_file;
+    QDataStream m_in;
+    bool m_valid;
+};
+
+#endif // WINDOWTRACE_H
@@ -18,7 +18,9 @@
  */
 
 #include "xwindowinterface.h"
+#include "processinfocache.h"
 #include "utils.h"
+#include "windowtrace.h"
 
 #include <QTimer>
 #include <QDebug>
@@ -26,35 +28,219 @@
 #include <QWindow>
 #include <QScreen>
 
+#include <cstring>
+
 #include <KWindowEffects>
 #include <KWindowSystem>
 #include <KWindowInfo>
 #include <KX11Extras>
+#include <KStartupInfo>
 
 // X11
 #include <NETWM>
+#include <xcb/xcb.h>
+
+namespace {
+
+enum AtomIndex {
+    NetWmWindowType = 0,
+    NetWmState,
+    NetWmVisibleName,
+    NetWmName,
+    NetWmPid,
+    NetWmDesktop,
+    NetStartupId,
+    NetWmIconGeometry,
+    Utf8String,
+    TypeNormal,
+    TypeDesktop,
+    TypeDock,
+    TypeToolbar,
+    TypeMenu,
+    TypeUtility,
+    TypeSplash,
+    TypeDialog,
+    TypeDropdownMenu,
+    TypePopupMenu,
+    TypeTooltip,
+    TypeNotification,
+    TypeComboBox,
+    TypeDnd,
+    StateSkipTaskbar,
+    StateSkipPager,
+    StateHidden,
+    StateDemandsAttention,
+    StateMaxVert,
+    StateMaxHoriz,
+    AtomCount
+};
+
+const char *const AtomNames[AtomCount] = {
+    "_NET_WM_WINDOW_TYPE",
+    "_NET_WM_STATE",
+    "_NET_WM_VISIBLE_NAME",
+    "_NET_WM_NAME",
+    "_NET_WM_PID",
+    "_NET_WM_DESKTOP",
+    "_NET_STARTUP_ID",
+    "_NET_WM_ICON_GEOMETRY",
+    "UTF8_STRING",
+    "_NET_WM_WINDOW_TYPE_NORMAL",
+    "_NET_WM_WINDOW_TYPE_DESKTOP",
+    "_NET_WM_WINDOW_TYPE_DOCK",
+    "_NET_WM_WINDOW_TYPE_TOOLBAR",
+    "_NET_WM_WINDOW_TYPE_MENU",
+    "_NET_WM_WINDOW_TYPE_UTILITY",
+    "_NET_WM_WINDOW_TYPE_SPLASH",
+    "_NET_WM_WINDOW_TYPE_DIALOG",
+    "_NET_WM_WINDOW_TYPE_DROPDOWN_MENU",
+    "_NET_WM_WINDOW_TYPE_POPUP_MENU",
+    "_NET_WM_WINDOW_TYPE_TOOLTIP",
+    "_NET_WM_WINDOW_TYPE_NOTIFICATION",
+    "_NET_WM_WINDOW_TYPE_COMBO",
+    "_NET_WM_WINDOW_TYPE_DND",
+    "_NET_WM_STATE_SKIP_TASKBAR",
+    "_NET_WM_STATE_SKIP_PAGER",
+    "_NET_WM_STATE_HIDDEN",
+    "_NET_WM_STATE_DEMANDS_ATTENTION",
+    "_NET_WM_STATE_MAXIMIZED_VERT",
+    "_NET_WM_STATE_MAXIMIZED_HORZ"
+};
+
+const struct {
+    AtomIndex atom;
+    NET::WindowType type;
+} WindowTypes[] = {
+    { TypeNormal, NET::Normal },
+    { TypeDesktop, NET::Desktop },
+    { TypeDock, NET::Dock },
+    { TypeToolbar, NET::Toolbar },
+    { TypeMenu, NET::Menu },
+    { TypeUtility, NET::Utility },
+    { TypeSplash, NET::Splash },
+    { TypeDialog, NET::Dialog },
+    { TypeDropdownMenu, NET::DropdownMenu },
+    { TypePopupMenu, NET::PopupMenu },
+    { TypeTooltip, NET::Tooltip },
+    { TypeNotification, NET::Notification },
+    { TypeComboBox, NET::ComboBox },
+    { TypeDnd, NET::DNDIcon }
+};
+
+const struct {
+    AtomIndex atom;
+    NET::State state;
+} WindowStates[] = {
+    { StateSkipTaskbar, NET::SkipTaskbar },
+    { StateSkipPager, NET::SkipPager },
+    { StateHidden, NET::Hidden },
+    { StateDemandsAttention, NET::DemandsAttention },
+    { StateMaxVert, NET::MaxVert },
+    { StateMaxHoriz, NET::MaxHoriz }
+};
+
+typedef QScopedPointer<xcb_get_property_reply_t, QScopedPointerPodDeleter> PropertyReply;
+
+// Interned once, all in one round-trip.
+const xcb_atom_t *atoms(xcb_connection_t *c)
+{
+    static xcb_atom_t table[AtomCount] = {};
+    static bool interned = false;
+
+    if (interned)
+        return table;
+
+    xcb_intern_atom_cookie_t cookies[AtomCount];
+
+    for (int i = 0; i < AtomCount; ++i)
+        cookies[i] = xcb_intern_atom(c, false, strlen(AtomNames[i]), AtomNames[i]);
+
+    for (int i = 0; i < AtomCount; ++i) {
+        QScopedPointer<xcb_intern_atom_reply_t, QScopedPointerPodDeleter> reply(xcb_intern_atom_reply(c, cookies[i], nullptr));
+
+        if (reply)
+            table[i] = reply->atom;
+    }
+
+    interned = true;
+    return table;
+}
+
+xcb_get_property_cookie_t getProperty(xcb_connection_t *c, xcb_window_t window,
+                                      xcb_atom_t property, xcb_atom_t type)
+{
+    return xcb_get_property(c, false, window, property, type, 0, 1024);
+}
 
-static XWindowInterface *INSTANCE = nullptr;
+QByteArray propertyBytes(const PropertyReply &reply)
+{
+    if (!reply || reply->format != 8)
+        return QByteArray();
+
+    return QByteArray(static_cast<const char *>(xcb_get_property_value(reply.data())),
+                      xcb_get_property_value_length(reply.data()));
+}
 
-XWindowInterface *XWindowInterface::instance()
+const quint32 *propertyWords(const PropertyReply &reply, int *count)
 {
-    if (!INSTANCE)
-        INSTANCE = new XWindowInterface;
+    *count = 0;
+
+    if (!reply || reply->format != 32)
+        return nullptr;
+
+    *count = xcb_get_property_value_length(reply.data()) / 4;
+    return static_cast<const quint32 *>(xcb_get_property_value(reply.data()));
+}
+
+NET::WindowType windowType(const PropertyReply &reply, const xcb_atom_t *atoms)
+{
+    int count = 0;
+    const quint32 *types = propertyWords(reply, &count);
+
+    // The first type the dock knows about wins.
+    for (int i = 0; i < count; ++i) {
+        for (const auto &entry : WindowTypes) {
+            if (types[i] == atoms[entry.atom])
+                return entry.type;
+        }
+    }
+
+    return NET::Unknown;
+}
 
-    return INSTANCE;
 }
 
 XWindowInterface::XWindowInterface(QObject *parent)
-    : QObject(parent)
+    : WindowBackend(parent)
+    , m_startupInfo(new KStartupInfo(KStartupInfo::CleanOnCantDetect, this))
+    , m_trace(WindowTraceWriter::fromEnvironment())
+    , m_cacheHits(0)
+    , m_roundTrips(0)
 {
+    // Sent by the application itself, or on timeout.
+    connect(m_startupInfo, &KStartupInfo::gotRemoveStartup, this, [=] (const KStartupInfoId &id) {
+        emit startupFinished(id.id());
+    });
+
     connect(KX11Extras::self(), &KX11Extras::windowAdded, this, &XWindowInterface::onWindowadded);
-    connect(KX11Extras::self(), &KX11Extras::windowRemoved, this, &XWindowInterface::windowRemoved);
-    connect(KX11Extras::self(), &KX11Extras::activeWindowChanged, this, &XWindowInterface::activeChanged);
+    connect(KX11Extras::self(), &KX11Extras::windowRemoved, this, &XWindowInterface::onWindowRemoved);
+    connect(KX11Extras::self(), &KX11Extras::windowChanged, this, &XWindowInterface::onWindowChanged);
+    connect(KX11Extras::self(), &KX11Extras::activeWindowChanged, this, [=] (WId wid) {
+        if (m_trace)
+            m_trace->record(WindowTrace::Activated, wid);
+
+        emit activeChanged(wid);
+    });
 }
 
-void XWindowInterface::enableBlurBehind(QWindow *view, bool enable, const QRegion &region)
+QList<quint64> XWindowInterface::windows()
 {
-    KWindowEffects::enableBlurBehind(view, enable, region);
+    QList<quint64> wids;
+
+    for (WId wid : KX11Extras::windows())
+        wids.append(wid);
+
+    return wids;
 }
 
 WId XWindowInterface::activeWindow()
@@ -78,70 +264,150 @@ void XWindowInterface::forceActiveWindow(WId win)
     KX11Extras::forceActiveWindow(win);
 }
 
-QMap<QString, QVariant> XWindowInterface::requestInfo(quint64 wid)
+XWindowInterface::WindowProperties XWindowInterface::properties(quint64 wid)
 {
-    const KWindowInfo winfo { wid, NET::WMFrameExtents
-                | NET::WMWindowType
-                | NET::WMGeometry
-                | NET::WMDesktop
-                | NET::WMState
-                | NET::WMName
-                | NET::WMVisibleName,
-                NET::WM2WindowClass
-                | NET::WM2Activities
-                | NET::WM2AllowedActions
-                | NET::WM2TransientFor };
-    QMap<QString, QVariant> result;
-    const QString winClass = QString(winfo.windowClassClass());
-
-    result.insert("iconName", winClass.toLower());
-    result.insert("active", wid == KX11Extras::activeWindow());
-    result.insert("visibleName", winfo.visibleName());
-    result.insert("id", winClass);
+    if (wid == 0)
+        return WindowProperties();
 
-    return result;
+    return cachedProperties(wid);
 }
 
-QString XWindowInterface::requestWindowClass(quint64 wid)
+const XWindowInterface::WindowProperties &XWindowInterface::cachedProperties(quint64 wid)
 {
-    return KWindowInfo(wid, NET::Supported, NET::WM2WindowClass).windowClassClass();
+    auto it = m_properties.constFind(wid);
+
+    if (it == m_properties.constEnd())
+        it = m_properties.insert(wid, fetchProperties(QList<WId>() << wid).first());
+    else
+        ++m_cacheHits;
+
+    return it.value();
 }
 
-bool XWindowInterface::isAcceptableWindow(quint64 wid)
+// Sends every request for every window before reading any reply, so
+// that a whole batch costs two round-trips instead of several per window.
+QList<XWindowInterface::WindowProperties> XWindowInterface::fetchProperties(const QList<WId> &wids)
 {
-    QFlags<NET::WindowTypeMask> ignoreList;
-    ignoreList |= NET::DesktopMask;
-    ignoreList |= NET::DockMask;
-    ignoreList |= NET::SplashMask;
-    ignoreList |= NET::ToolbarMask;
-    ignoreList |= NET::MenuMask;
-    ignoreList |= NET::PopupMenuMask;
-    ignoreList |= NET::NotificationMask;
+    xcb_connection_t *c = QX11Info::connection();
+    const xcb_atom_t *atom = atoms(c);
+
+    struct Cookies {
+        xcb_get_property_cookie_t type;
+        xcb_get_property_cookie_t state;
+        xcb_get_property_cookie_t windowClass;
+        xcb_get_property_cookie_t visibleName;
+        xcb_get_property_cookie_t name;
+        xcb_get_property_cookie_t wmName;
+        xcb_get_property_cookie_t pid;
+        xcb_get_property_cookie_t transientFor;
+        xcb_get_property_cookie_t desktop;
+        xcb_get_property_cookie_t startupId;
+    };
+
+    QVector<Cookies> cookies;
+    cookies.reserve(wids.size());
+
+    for (WId wid : wids) {
+        const xcb_window_t w = wid;
+        Cookies cookie;
+        cookie.type = getProperty(c, w, atom[NetWmWindowType], XCB_ATOM_ATOM);
+        cookie.state = getProperty(c, w, atom[NetWmState], XCB_ATOM_ATOM);
+        cookie.windowClass = getProperty(c, w, XCB_ATOM_WM_CLASS, XCB_ATOM_STRING);
+        cookie.visibleName = getProperty(c, w, atom[NetWmVisibleName], atom[Utf8String]);
+        cookie.name = getProperty(c, w, atom[NetWmName], atom[Utf8String]);
+        cookie.wmName = getProperty(c, w, XCB_ATOM_WM_NAME, XCB_GET_PROPERTY_TYPE_ANY);
+        cookie.pid = getProperty(c, w, atom[NetWmPid], XCB_ATOM_CARDINAL);
+        cookie.transientFor = getProperty(c, w, XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW);
+        cookie.desktop = getProperty(c, w, atom[NetWmDesktop], XCB_ATOM_CARDINAL);
+        cookie.startupId = getProperty(c, w, atom[NetStartupId], atom[Utf8String]);
+        cookies.append(cookie);
+    }
+
+    QList<WindowProperties> result;
+    result.reserve(wids.size());
+
+    if (!wids.isEmpty())
+        ++m_roundTrips;
+
+    QHash<xcb_window_t, xcb_get_property_cookie_t> parentCookies;
+
+    for (int i = 0; i < cookies.size(); ++i) {
+        const Cookies &cookie = cookies.at(i);
+        WindowProperties properties;
+        int count = 0;
+
+        PropertyReply type(xcb_get_property_reply(c, cookie.type, nullptr));
+        PropertyReply state(xcb_get_property_reply(c, cookie.state, nullptr));
+        PropertyReply windowClass(xcb_get_property_reply(c, cookie.windowClass, nullptr));
+        PropertyReply visibleName(xcb_get_property_reply(c, cookie.visibleName, nullptr));
+        PropertyReply name(xcb_get_property_reply(c, cookie.name, nullptr));
+        PropertyReply wmName(xcb_get_property_reply(c, cookie.wmName, nullptr));
+        PropertyReply pid(xcb_get_property_reply(c, cookie.pid, nullptr));
+        PropertyReply transientFor(xcb_get_property_reply(c, cookie.transientFor, nullptr));
+        PropertyReply desktop(xcb_get_property_reply(c, cookie.desktop, nullptr));
+        PropertyReply startupId(xcb_get_property_reply(c, cookie.startupId, nullptr));
+
+        // No reply at all means the window is already gone.
+        properties.valid = !type.isNull();
+        properties.type = windowType(type, atom);
+
+        const quint32 *states = propertyWords(state, &count);
 
-    KWindowInfo info(wid, NET::WMWindowType | NET::WMState, NET::WM2TransientFor | NET::WM2WindowClass);
+        for (int j = 0; j < count; ++j) {
+            for (const auto &entry : WindowStates) {
+                if (states[j] == atom[entry.atom])
+                    properties.state |= entry.state;
+            }
+        }
 
-    if (!info.valid())
-        return false;
+        // WM_CLASS is "instance\0class\0".
+        const QList<QByteArray> classes = propertyBytes(windowClass).split('\0');
+        properties.instanceName = classes.value(0);
+        properties.windowClass = classes.value(1);
 
-    if (NET::typeMatchesMask(info.windowType(NET::AllTypesMask), ignoreList))
-        return false;
+        properties.name = QString::fromUtf8(propertyBytes(visibleName));
 
-    if (info.hasState(NET::SkipTaskbar) || info.hasState(NET::SkipPager))
-        return false;
+        if (properties.name.isEmpty())
+            properties.name = QString::fromUtf8(propertyBytes(name));
+        if (properties.name.isEmpty())
+            properties.name = QString::fromLocal8Bit(propertyBytes(wmName));
 
-    // WM_TRANSIENT_FOR hint not set - normal window
-    WId transFor = info.transientFor();
-    if (transFor == 0 || transFor == wid || transFor == (WId) QX11Info::appRootWindow())
-        return true;
+        if (const quint32 *value = propertyWords(pid, &count))
+            properties.pid = count > 0 ? value[0] : 0;
+        if (const quint32 *value = propertyWords(transientFor, &count))
+            properties.transientFor = count > 0 ? value[0] : 0;
+        if (properties.transientFor == QX11Info::appRootWindow())
+            properties.transientFor = 0;
+        if (const quint32 *value = propertyWords(desktop, &count))
+            properties.desktop = count > 0 ? int(value[0]) : 0;
 
-    info = KWindowInfo(transFor, NET::WMWindowType);
+        properties.startupId = propertyBytes(startupId);
 
-    QFlags<NET::WindowTypeMask> normalFlag;
-    normalFlag |= NET::NormalMask;
-    normalFlag |= NET::DialogMask;
-    normalFlag |= NET::UtilityMask;
+        const xcb_window_t parent = properties.transientFor;
 
-    return !NET::typeMatchesMask(info.windowType(NET::AllTypesMask), normalFlag);
+        if (parent != 0 && parent != wids.at(i) && !parentCookies.contains(parent))
+            parentCookies.insert(parent, getProperty(c, parent, atom[NetWmWindowType], XCB_ATOM_ATOM));
+
+        result.append(properties);
+    }
+
+    // Second round for the windows that dialogs are transient for.
+    QHash<xcb_window_t, NET::WindowType> parentTypes;
+
+    if (!parentCookies.isEmpty())
+        ++m_roundTrips;
+
+    for (auto it = parentCookies.constBegin(); it != parentCookies.constEnd(); ++it) {
+        PropertyReply type(xcb_get_property_reply(c, it.value(), nullptr));
+        parentTypes.insert(it.key(), windowType(type, atom));
+    }
+
+    for (WindowProperties &properties : result) {
+        if (properties.transientFor != 0)
+            properties.transientForType = parentTypes.value(xcb_window_t(properties.transientFor), NET::Unknown);
+    }
+
+    return result;
 }
 
 void XWindowInterface::setViewStruts(QWindow *view, DockSettings::Direction direction, const QRect &rect, bool compositing)
@@ -195,20 +461,35 @@ void XWindowInterface::clearViewStruts(QWindow *view)
 
 void XWindowInterface::startInitWindows()
 {
-    for (auto wid : KX11Extras::self()->windows()) {
-        onWindowadded(wid);
+    const QList<WId> wids = KX11Extras::self()->windows();
+    const QList<WindowProperties> fetched = fetchProperties(wids);
+    QList<quint64> accepted;
+
+    for (int i = 0; i < wids.size(); ++i) {
+        m_properties.insert(wids.at(i), fetched.at(i));
+
+        if (m_trace)
+            m_trace->record(WindowTrace::Added, wids.at(i), fetched.at(i));
+
+        if (isAcceptable(wids.at(i), fetched.at(i)))
+            accepted.append(wids.at(i));
     }
+
+    emit windowsAdded(accepted);
 }
 
 QString XWindowInterface::desktopFilePath(quint64 wid)
 {
-    const KWindowInfo info(wid, NET::Properties(), NET::WM2WindowClass | NET::WM2DesktopFileName);
-    return Utils::instance()->desktopPathFromMetadata(info.windowClassClass(),
-                                                      NETWinInfo(QX11Info::connection(), wid,
-                                                                 QX11Info::appRootWindow(),
-                                                                 NET::WMPid,
-                                                                 NET::Properties2()).pid(),
-                                                      info.windowClassName());
+    const WindowProperties &info = cachedProperties(wid);
+    const quint32 pid = info.pid;
+
+    // Keep the owner's /proc data around while it has windows.
+    if (!m_windowPids.contains(wid)) {
+        m_windowPids.insert(wid, pid);
+        ProcessInfoCache::self()->retain(pid);
+    }
+
+    return Utils::instance()->desktopPathFromMetadata(info.windowClass, pid, info.instanceName);
 }
 
 void XWindowInterface::setIconGeometry(quint64 wid, const QRect &rect)
@@ -226,9 +507,124 @@ void XWindowInterface::setIconGeometry(quint64 wid, const QRect &rect)
     info.setIconGeometry(nrect);
 }
 
+// Plain property writes, NETWinInfo would read the old value first.
+void XWindowInterface::setIconGeometries(const QHash<quint64, QRect> &geometries)
+{
+    xcb_connection_t *c = QX11Info::connection();
+    const xcb_atom_t *atom = atoms(c);
+
+    for (auto it = geometries.constBegin(); it != geometries.constEnd(); ++it) {
+        const QRect &rect = it.value();
+        const quint32 data[4] = { quint32(rect.x()), quint32(rect.y()), quint32(rect.width()), quint32(rect.height()) };
+
+        xcb_change_property(c, XCB_PROP_MODE_REPLACE, it.key(), atom[NetWmIconGeometry],
+                            XCB_ATOM_CARDINAL, 32, 4, data);
+    }
+
+    xcb_flush(c);
+}
+
+QByteArray XWindowInterface::createStartupId()
+{
+    return KStartupInfo::createNewStartupId();
+}
+
+void XWindowInterface::sendStartup(const QByteArray &id, const QString &name, const QString &iconName,
+                                   const QString &desktopPath, const QString &bin)
+{
+    KStartupInfoId startup;
+    startup.initId(id);
+
+    KStartupInfoData data;
+    data.setName(name);
+    data.setIcon(iconName);
+    data.setBin(bin);
+
+    if (!desktopPath.isEmpty())
+        data.setApplicationId(desktopPath);
+
+    KStartupInfo::sendStartup(startup, data);
+}
+
+void XWindowInterface::sendStartupFinished(const QByteArray &id)
+{
+    KStartupInfoId startup;
+    startup.initId(id);
+    KStartupInfo::sendFinish(startup);
+}
+
+QByteArray XWindowInterface::startupId(quint64 wid)
+{
+    QByteArray id = cachedProperties(wid).startupId;
+
+    // Clients that drop DESKTOP_STARTUP_ID are matched by
+    // _NET_WM_PID or their class instead.
+    if (id.isEmpty()) {
+        KStartupInfoId startup;
+        KStartupInfoData data;
+
+        if (m_startupInfo->checkStartup(wid, startup, data) == KStartupInfo::Match)
+            id = startup.id();
+    }
+
+    return id;
+}
+
+QVariantMap XWindowInterface::cacheStats() const
+{
+    QVariantMap stats;
+    stats.insert("windows", m_properties.size());
+    stats.insert("hits", m_cacheHits);
+    stats.insert("roundTrips", m_roundTrips);
+    return stats;
+}
+
 void XWindowInterface::onWindowadded(quint64 wid)
 {
+    if (m_trace)
+        m_trace->record(WindowTrace::Added, wid, cachedProperties(wid));
+
     if (isAcceptableWindow(wid)) {
         emit windowAdded(wid);
     }
 }
+
+void XWindowInterface::onWindowRemoved(quint64 wid)
+{
+    auto it = m_windowPids.find(wid);
+
+    if (it != m_windowPids.end()) {
+        ProcessInfoCache::self()->release(it.value());
+        m_windowPids.erase(it);
+    }
+
+    m_properties.remove(wid);
+
+    if (m_trace)
+        m_trace->record(WindowTrace::Removed, wid);
+
+    emit windowRemoved(wid);
+}
+
+void XWindowInterface::onWindowChanged(WId wid, NET::Properties changed, NET::Properties2 changed2)
+{
+    // Geometry and icon changes are by far the most frequent ones,
+    // only refetch when something the dock keeps has changed.
+    const NET::Properties watched = NET::WMWindowType | NET::WMState | NET::WMName
+                                  | NET::WMVisibleName | NET::WMPid | NET::WMDesktop;
+    const NET::Properties2 watched2 = NET::WM2WindowClass | NET::WM2TransientFor | NET::WM2StartupId;
+
+    if (!(changed & watched) && !(changed2 & watched2))
+        return;
+
+    auto it = m_properties.find(wid);
+
+    if (it != m_properties.end()) {
+        it.value() = fetchProperties(QList<WId>() << wid).first();
+
+        if (m_trace)
+            m_trace->record(WindowTrace::Changed, wid, it.value());
+
+        emit windowChanged(wid);
+    }
+}
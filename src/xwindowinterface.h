@@ -20,49 +20,67 @@
 #ifndef XWINDOWINTERFACE_H
 #define XWINDOWINTERFACE_H
 
-#include "applicationitem.h"
-#include "docksettings.h"
-#include <QObject>
+#include "windowbackend.h"
 
 // KLIB
 #include <KWindowInfo>
 #include <KWindowEffects>
 
-class XWindowInterface : public QObject
+class KStartupInfo;
+class WindowTraceWriter;
+
+class XWindowInterface : public WindowBackend
 {
     Q_OBJECT
 
 public:
-    static XWindowInterface *instance();
     explicit XWindowInterface(QObject *parent = nullptr);
 
-    void enableBlurBehind(QWindow *view, bool enable = true, const QRegion &region = QRegion());
+    QList<quint64> windows() override;
+    WId activeWindow() override;
+    WindowProperties properties(quint64 wid) override;
+    QString desktopFilePath(quint64 wid) override;
 
-    WId activeWindow();
-    void minimizeWindow(WId win);
-    void closeWindow(WId id);
-    void forceActiveWindow(WId win);
+    void startInitWindows() override;
 
-    QMap<QString, QVariant> requestInfo(quint64 wid);
-    QString requestWindowClass(quint64 wid);
-    bool isAcceptableWindow(quint64 wid);
+    void forceActiveWindow(WId win) override;
+    void minimizeWindow(WId win) override;
+    void closeWindow(WId id) override;
+    void setIconGeometry(quint64 wid, const QRect &rect) override;
+    void setIconGeometries(const QHash<quint64, QRect> &geometries) override;
 
-    void setViewStruts(QWindow *view, DockSettings::Direction direction, const QRect &rect, bool compositing = false);
-    void clearViewStruts(QWindow *view);
+    void setViewStruts(QWindow *view, DockSettings::Direction direction, const QRect &rect, bool compositing = false) override;
+    void clearViewStruts(QWindow *view) override;
 
-    void startInitWindows();
+    QByteArray createStartupId() override;
+    void sendStartup(const QByteArray &id, const QString &name, const QString &iconName,
+                     const QString &desktopPath, const QString &bin) override;
+    void sendStartupFinished(const QByteArray &id) override;
+    QByteArray startupId(quint64 wid) override;
 
-    QString desktopFilePath(quint64 wid);
+    // Property reads answered from memory vs. round-trips to the server.
+    QVariantMap cacheStats() const override;
 
-    void setIconGeometry(quint64 wid, const QRect &rect);
+private:
+    const WindowProperties &cachedProperties(quint64 wid);
+    QList<WindowProperties> fetchProperties(const QList<WId> &wids);
 
-signals:
-    void windowAdded(quint64 wid);
-    void windowRemoved(quint64 wid);
-    void activeChanged(quint64 wid);
+    void onWindowadded(quint64 wid);
+    void onWindowRemoved(quint64 wid);
+    void onWindowChanged(WId wid, NET::Properties changed, NET::Properties2 changed2);
 
 private:
-    void onWindowadded(quint64 wid);
+    KStartupInfo *m_startupInfo;
+    // Set through LINGMO_DOCK_TRACE.
+    WindowTraceWriter *m_trace;
+
+    // Properties of every window seen so far, until it is removed.
+    QHash<quint64, WindowProperties> m_properties;
+    quint64 m_cacheHits;
+    quint64 m_roundTrips;
+
+    // Owner of every window resolved so far.
+    QHash<quint64, quint32> m_windowPids;
 };
 
 #endif // XWINDOWINTERFACE_H
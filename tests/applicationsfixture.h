@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef APPLICATIONSFIXTURE_H
+#define APPLICATIONSFIXTURE_H
+
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+
+// A home of its own, holding tests/data/applications next to a few
+// thousand generated entries, the size of a typical desktop. Set up
+// before any singleton looks at the XDG directories, the real ones
+// stay untouched.
+class ApplicationsFixture
+{
+public:
+    static const int FillerCount = 3000;
+
+    bool setUp();
+
+    QString applicationsDir() const { return m_home.path() + "/data/applications"; }
+
+private:
+    static bool writeFile(const QString &fileName, const QByteArray &data);
+
+private:
+    QTemporaryDir m_home;
+};
+
+inline bool ApplicationsFixture::writeFile(const QString &fileName, const QByteArray &data)
+{
+    QFile file(fileName);
+    return file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+}
+
+inline bool ApplicationsFixture::setUp()
+{
+    if (!m_home.isValid())
+        return false;
+
+    qputenv("XDG_DATA_HOME", QFile::encodeName(m_home.path() + "/data"));
+    qputenv("XDG_DATA_DIRS", QFile::encodeName(m_home.path() + "/share"));
+    qputenv("XDG_CONFIG_HOME", QFile::encodeName(m_home.path() + "/config"));
+    qputenv("XDG_CACHE_HOME", QFile::encodeName(m_home.path() + "/cache"));
+
+    if (!QDir().mkpath(applicationsDir()))
+        return false;
+
+    for (int i = 0; i < FillerCount; ++i) {
+        const QByteArray name = "filler-" + QByteArray::number(i);
+        const QByteArray data = "[Desktop Entry]\n"
+                                "Type=Application\n"
+                                "Name=Filler " + QByteArray::number(i) + "\n"
+                                "Icon=" + name + "\n"
+                                "Exec=" + name + " %U\n"
+                                "StartupWMClass=Filler-" + QByteArray::number(i) + "\n";
+
+        if (!writeFile(applicationsDir() + "/" + name + ".desktop", data))
+            return false;
+    }
+
+    const QDir fixtures(FIXTURES_DIR "/applications");
+
+    for (const QString &fileName : fixtures.entryList({ "*.desktop" }, QDir::Files)) {
+        if (!QFile::copy(fixtures.filePath(fileName), applicationsDir() + "/" + fileName))
+            return false;
+    }
+
+    return true;
+}
+
+#endif // APPLICATIONSFIXTURE_H
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include <unistd.h>
+
+#include "applicationmodel.h"
+#include "syntheticbackend.h"
+
+// Drives ApplicationModel through the synthetic backend, applying every
+// batch of window events right away instead of on the next frame.
+class TestApplicationModel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void windowEvents_data();
+    void windowEvents();
+
+    void soak();
+
+private:
+    quint64 addWindow();
+    static int windowCount(const ApplicationModel &model);
+    static qint64 residentKiB();
+
+private:
+    QTemporaryDir m_home;
+    SyntheticBackend *m_backend = nullptr;
+};
+
+void TestApplicationModel::initTestCase()
+{
+    QVERIFY(m_home.isValid());
+
+    // No desktop files and no pinned applications, and the real ones
+    // stay untouched.
+    qputenv("XDG_DATA_HOME", QFile::encodeName(m_home.path() + "/data"));
+    qputenv("XDG_DATA_DIRS", QFile::encodeName(m_home.path() + "/share"));
+    qputenv("XDG_CONFIG_HOME", QFile::encodeName(m_home.path() + "/config"));
+    qputenv("XDG_CACHE_HOME", QFile::encodeName(m_home.path() + "/cache"));
+
+    qputenv("LINGMO_DOCK_BACKEND", "synthetic");
+    qputenv("LINGMO_DOCK_SYNTHETIC_WINDOWS", "0");
+    qputenv("LINGMO_DOCK_SYNTHETIC_RATE", "0");
+
+    m_backend = qobject_cast<SyntheticBackend *>(WindowBackend::self());
+    QVERIFY(m_backend);
+}
+
+// A random class, but always a window the dock shows.
+quint64 TestApplicationModel::addWindow()
+{
+    WindowBackend::WindowProperties properties = m_backend->randomWindow();
+    properties.type = NET::Normal;
+    properties.state = NET::States();
+    properties.transientFor = 0;
+    properties.transientForType = NET::Unknown;
+
+    return m_backend->addWindow(properties);
+}
+
+int TestApplicationModel::windowCount(const ApplicationModel &model)
+{
+    int count = 0;
+
+    for (int row = 0; row < model.rowCount(); ++row)
+        count += model.index(row, 0).data(ApplicationModel::WindowCountRole).toInt();
+
+    return count;
+}
+
+qint64 TestApplicationModel::residentKiB()
+{
+    QFile file("/proc/self/statm");
+
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+
+    const QList<QByteArray> fields = file.readAll().split(' ');
+    return fields.value(1).toLongLong() * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+void TestApplicationModel::windowEvents_data()
+{
+    QTest::addColumn<int>("windows");
+    QTest::addColumn<bool>("activate");
+
+    for (int windows : { 10, 100, 1000 }) {
+        QTest::addRow("add and remove, %d windows", windows) << windows << false;
+        QTest::addRow("activate, %d windows", windows) << windows << true;
+    }
+}
+
+// The cost of one event should not depend on how many windows are open.
+// A window is added and removed again in the same iteration, so that
+// the count stays where the row put it.
+void TestApplicationModel::windowEvents()
+{
+    QFETCH(int, windows);
+    QFETCH(bool, activate);
+
+    ApplicationModel model;
+    QList<quint64> wids;
+
+    for (int i = 0; i < windows; ++i)
+        wids.append(addWindow());
+
+    model.flushWindowEvents();
+    QCOMPARE(windowCount(model), windows);
+
+    if (activate) {
+        int next = 0;
+
+        QBENCHMARK {
+            m_backend->setActiveWindow(wids.at(next));
+            model.flushWindowEvents();
+            next = (next + 1) % wids.size();
+        }
+    } else {
+        QBENCHMARK {
+            const quint64 wid = addWindow();
+            model.flushWindowEvents();
+            m_backend->removeWindow(wid);
+            model.flushWindowEvents();
+        }
+    }
+
+    QCOMPARE(windowCount(model), windows);
+
+    for (quint64 wid : qAsConst(wids))
+        m_backend->removeWindow(wid);
+
+    model.flushWindowEvents();
+    QCOMPARE(windowCount(model), 0);
+}
+
+// 100k windows opened and closed in batches. Items that are not given
+// back show up in the item counts, anything else that grows with the
+// number of windows seen shows up in the resident set.
+void TestApplicationModel::soak()
+{
+    static const int Windows = 100000;
+    static const int BatchSize = 500;
+    // Allocator slack, far below what a few bytes per window add up to.
+    static const qint64 MaxRssGrowth = 4 * 1024;
+
+    ApplicationModel model;
+
+    auto batch = [&] {
+        QList<quint64> wids;
+
+        for (int i = 0; i < BatchSize; ++i)
+            wids.append(addWindow());
+
+        model.flushWindowEvents();
+
+        for (quint64 wid : qAsConst(wids))
+            m_backend->removeWindow(wid);
+
+        model.flushWindowEvents();
+    };
+
+    // The first batch brings the pools and hashes to their working size.
+    batch();
+
+    const QVariantMap baseline = model.itemStats();
+    const qint64 baselineRss = residentKiB();
+    QVERIFY(baselineRss > 0);
+
+    for (int opened = BatchSize; opened < Windows; opened += BatchSize)
+        batch();
+
+    const QVariantMap stats = model.itemStats();
+    QCOMPARE(stats.value("live").toInt(), baseline.value("live").toInt());
+    QVERIFY(stats.value("allocated").toInt() <= baseline.value("allocated").toInt());
+
+    const qint64 growth = residentKiB() - baselineRss;
+    QVERIFY2(growth <= MaxRssGrowth, qPrintable(QString("resident set grew by %1 KiB").arg(growth)));
+}
+
+QTEST_MAIN(TestApplicationModel)
+
+#include "tst_applicationmodel.moc"
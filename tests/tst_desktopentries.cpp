@@ -0,0 +1,421 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtTest>
+#include <QRegularExpression>
+#include <QSettings>
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "desktopfileparser.h"
+#include "systemappmonitor.h"
+
+#include "applicationsfixture.h"
+
+// The .desktop parser, and the application index built with it.
+class TestDesktopEntries : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void unescape_data();
+    void unescape();
+    void unescapeList();
+    void localeRank_data();
+    void localeRank();
+    void groups();
+    void tokenizeExec_data();
+    void tokenizeExec();
+    void expandExec_data();
+    void expandExec();
+    void programIndex_data();
+    void programIndex();
+
+    void parse_data();
+    void parse();
+
+    void indexStartup_data();
+    void indexStartup();
+
+    void parseApplications_data();
+    void parseApplications();
+
+private:
+    static DesktopFileParser::Entry parseEntry(const QByteArray &data, const QString &locale = "C");
+    QString applicationsDir() const { return m_fixture.applicationsDir(); }
+    static bool evict(const QString &fileName, bool sync = false);
+
+private:
+    ApplicationsFixture m_fixture;
+};
+
+void TestDesktopEntries::initTestCase()
+{
+    QVERIFY(m_fixture.setUp());
+}
+
+DesktopFileParser::Entry TestDesktopEntries::parseEntry(const QByteArray &data, const QString &locale)
+{
+    DesktopFileParser::Entry entry;
+    DesktopFileParser(locale).parse(data.constData(), data.size(), &entry);
+    return entry;
+}
+
+void TestDesktopEntries::unescape_data()
+{
+    QTest::addColumn<QByteArray>("value");
+    QTest::addColumn<QString>("expected");
+
+    QTest::newRow("plain") << QByteArray("a b") << "a b";
+    QTest::newRow("space") << QByteArray(R"(a\sb)") << "a b";
+    QTest::newRow("controls") << QByteArray(R"(a\nb\tc\rd)") << "a\nb\tc\rd";
+    QTest::newRow("backslash") << QByteArray(R"(a\\b)") << R"(a\b)";
+    QTest::newRow("unknown kept") << QByteArray(R"(a\;b\x)") << R"(a\;b\x)";
+    QTest::newRow("trailing backslash") << QByteArray(R"(a\)") << R"(a\)";
+    QTest::newRow("utf-8") << QByteArray("\xc3\x9c" "bersicht") << QString::fromUtf8("\xc3\x9c" "bersicht");
+}
+
+void TestDesktopEntries::unescape()
+{
+    QFETCH(QByteArray, value);
+    QFETCH(QString, expected);
+
+    QCOMPARE(DesktopFileParser::unescape(value.constData(), value.size()), expected);
+    QCOMPARE(parseEntry("[Desktop Entry]\nComment=" + value + "\n").comment, expected);
+}
+
+void TestDesktopEntries::unescapeList()
+{
+    const QByteArray value = R"(GNOME;KDE\;X;LINGMO\s;)";
+
+    QCOMPARE(DesktopFileParser::unescapeList(value.constData(), value.size()),
+             QStringList({ "GNOME", "KDE;X", "LINGMO " }));
+    QCOMPARE(parseEntry("[Desktop Entry]\nOnlyShowIn=" + value + "\n").onlyShowIn,
+             QStringList({ "GNOME", "KDE;X", "LINGMO " }));
+}
+
+void TestDesktopEntries::localeRank_data()
+{
+    QTest::addColumn<QString>("locale");
+    QTest::addColumn<QString>("expected");
+
+    QTest::newRow("lang_COUNTRY@MODIFIER") << "de_DE@euro" << "Deutschland Euro";
+    QTest::newRow("lang_COUNTRY") << "de_DE.UTF-8" << "Deutschland";
+    QTest::newRow("lang@MODIFIER") << "de_AT@euro" << "Deutsch Euro";
+    QTest::newRow("lang") << "de_AT" << "Deutsch";
+    QTest::newRow("other language") << "fr_FR" << "Francais";
+    QTest::newRow("unlocalized") << "it_IT" << "Default";
+    QTest::newRow("C") << "C" << "Default";
+}
+
+void TestDesktopEntries::localeRank()
+{
+    QFETCH(QString, locale);
+    QFETCH(QString, expected);
+
+    // Shuffled, the rank decides and not the order.
+    const QByteArray data = "[Desktop Entry]\n"
+                            "Name[de]=Deutsch\n"
+                            "Name[de_DE@euro]=Deutschland Euro\n"
+                            "Name=Default\n"
+                            "Name[de_DE]=Deutschland\n"
+                            "Name[fr]=Francais\n"
+                            "Name[de@euro]=Deutsch Euro\n"
+                            "GenericName[it]=Generico\n"
+                            "Icon[de]=ignored\n"
+                            "Icon=icon\n";
+
+    const DesktopFileParser::Entry entry = parseEntry(data, locale);
+    QCOMPARE(entry.name, expected);
+    QCOMPARE(entry.genericName, locale.startsWith("it") ? "Generico" : QString());
+    QCOMPARE(entry.iconName, QStringLiteral("icon"));
+}
+
+void TestDesktopEntries::groups()
+{
+    const QByteArray data = "# Comment=ignored\n"
+                            "[Other Group]\n"
+                            "Name=Other\n"
+                            "\n"
+                            "[Desktop Entry]\n"
+                            "  Name = Entry \r\n"
+                            "Exec=app\n"
+                            "Terminal=true\n"
+                            "NoDisplay=1\n"
+                            "Hidden=false\n"
+                            "not a key\n"
+                            "[Desktop Action new]\n"
+                            "Exec=other\n"
+                            "Hidden=true\n";
+
+    DesktopFileParser::Entry entry;
+    QVERIFY(DesktopFileParser("C").parse(data.constData(), data.size(), &entry));
+    QCOMPARE(entry.name, QStringLiteral("Entry"));
+    QCOMPARE(entry.exec, QStringLiteral("app"));
+    QVERIFY(entry.terminal);
+    QVERIFY(entry.noDisplay);
+    QVERIFY(!entry.hidden);
+
+    const QByteArray missing = "[Other Group]\nName=Other\n";
+    QVERIFY(!DesktopFileParser("C").parse(missing.constData(), missing.size(), &entry));
+}
+
+void TestDesktopEntries::tokenizeExec_data()
+{
+    QTest::addColumn<QString>("exec");
+    QTest::addColumn<QStringList>("tokens");
+
+    QTest::newRow("plain") << "app  --flag\t%U" << QStringList({ "app", "--flag", "%U" });
+    QTest::newRow("quoted") << R"("/opt/my app/bin/app" --x)" << QStringList({ "/opt/my app/bin/app", "--x" });
+    QTest::newRow("quoted escapes") << R"(sh -c "echo \"hi\" \`id\` \$HOME \\ \n")"
+                                    << QStringList({ "sh", "-c", R"(echo "hi" `id` $HOME \ \n)" });
+    QTest::newRow("unquoted escape") << R"(app my\ file)" << QStringList({ "app", "my file" });
+    QTest::newRow("empty quotes") << R"(app "")" << QStringList({ "app", "" });
+    QTest::newRow("joined") << R"(app --name="a b"c)" << QStringList({ "app", "--name=a bc" });
+}
+
+void TestDesktopEntries::tokenizeExec()
+{
+    QFETCH(QString, exec);
+    QFETCH(QStringList, tokens);
+
+    QCOMPARE(DesktopFileParser::tokenizeExec(exec), tokens);
+}
+
+void TestDesktopEntries::expandExec_data()
+{
+    QTest::addColumn<QString>("exec");
+    QTest::addColumn<QStringList>("files");
+    QTest::addColumn<QStringList>("argv");
+
+    const QStringList files { "/tmp/a", "/tmp/b" };
+
+    QTest::newRow("%f") << "app %f" << files << QStringList({ "app", "/tmp/a" });
+    QTest::newRow("%f without files") << "app %f" << QStringList() << QStringList({ "app" });
+    QTest::newRow("%u") << "app %u" << files << QStringList({ "app", "/tmp/a" });
+    QTest::newRow("%F") << "app %F" << files << QStringList({ "app", "/tmp/a", "/tmp/b" });
+    QTest::newRow("%U") << "app %U" << files << QStringList({ "app", "/tmp/a", "/tmp/b" });
+    QTest::newRow("%i") << "app %i" << files << QStringList({ "app", "--icon", "icon" });
+    QTest::newRow("%c") << "app %c" << files << QStringList({ "app", "App" });
+    QTest::newRow("%k") << "app %k" << files << QStringList({ "app", "/apps/app.desktop" });
+    QTest::newRow("%%") << "app %%" << files << QStringList({ "app", "%" });
+    QTest::newRow("deprecated") << "app %d %D %n %N %v %m" << files << QStringList({ "app" });
+    QTest::newRow("inside an argument") << R"(app --title=%c 100%% "x %f")" << files
+                                        << QStringList({ "app", "--title=", "100%", "x " });
+}
+
+void TestDesktopEntries::expandExec()
+{
+    QFETCH(QString, exec);
+    QFETCH(QStringList, files);
+    QFETCH(QStringList, argv);
+
+    QCOMPARE(DesktopFileParser::expandExec(DesktopFileParser::tokenizeExec(exec), files,
+                                           "icon", "App", "/apps/app.desktop"), argv);
+}
+
+void TestDesktopEntries::programIndex_data()
+{
+    QTest::addColumn<QStringList>("argv");
+    QTest::addColumn<int>("index");
+
+    QTest::newRow("plain") << QStringList({ "app", "--flag" }) << 0;
+    QTest::newRow("env") << QStringList({ "env", "A=1", "B=2", "app" }) << 3;
+    QTest::newRow("env path") << QStringList({ "/usr/bin/env", "A=1", "app" }) << 2;
+    QTest::newRow("env options") << QStringList({ "env", "-i", "-u", "A", "app" }) << 4;
+    QTest::newRow("env alone") << QStringList({ "env", "A=1" }) << 0;
+}
+
+void TestDesktopEntries::programIndex()
+{
+    QFETCH(QStringList, argv);
+    QFETCH(int, index);
+
+    QCOMPARE(DesktopFileParser::programIndex(argv), index);
+}
+
+void TestDesktopEntries::parse_data()
+{
+    QTest::addColumn<bool>("settings");
+
+    QTest::newRow("DesktopFileParser") << false;
+    QTest::newRow("QSettings") << true;
+}
+
+// Every entry of the applications folder, against the QSettings
+// based reader the monitor used before DesktopFileParser.
+void TestDesktopEntries::parse()
+{
+    QFETCH(bool, settings);
+
+    const QDir dir(applicationsDir());
+    const QStringList fileNames = dir.entryList({ "*.desktop" }, QDir::Files);
+    const QString locale = QLocale::system().name();
+    const DesktopFileParser parser(locale);
+
+    DesktopFileParser::Entry fixture;
+    QVERIFY(DesktopFileParser("de_DE").parse(dir.filePath("org.example.Editor.desktop"), &fixture));
+    QCOMPARE(fixture.name, QStringLiteral("Beispiel-Editor (Deutschland)"));
+    QCOMPARE(fixture.comment, QStringLiteral("Edit text files"));
+    QCOMPARE(fixture.exec, QStringLiteral("example-editor --new-window %F"));
+    QCOMPARE(fixture.startupWMClass, QStringLiteral("ExampleEditor"));
+
+    QBENCHMARK {
+        for (const QString &fileName : fileNames) {
+            const QString filePath = dir.filePath(fileName);
+
+            if (!settings) {
+                DesktopFileParser::Entry entry;
+                parser.parse(filePath, &entry);
+                continue;
+            }
+
+            QSettings desktop(filePath, QSettings::IniFormat);
+            desktop.beginGroup("Desktop Entry");
+
+            if (desktop.value("Terminal").toBool())
+                continue;
+
+            desktop.value("OnlyShowIn");
+
+            if (desktop.value("NoDisplay").toBool() || desktop.value("Hidden").toBool())
+                continue;
+
+            QString appName = desktop.value(QString("Name[%1]").arg(locale)).toString();
+            QString appExec = desktop.value("Exec").toString();
+
+            if (appName.isEmpty())
+                appName = desktop.value("Name").toString();
+
+            appExec.remove(QRegularExpression("%."));
+            appExec.remove(QRegularExpression("^\""));
+            appExec = appExec.simplified();
+
+            desktop.value("GenericName").toString();
+            desktop.value("Comment").toString();
+            desktop.value("Icon").toString();
+            desktop.value("StartupWMClass").toString();
+        }
+    }
+}
+
+void TestDesktopEntries::indexStartup_data()
+{
+    QTest::addColumn<bool>("cached");
+
+    QTest::newRow("cold") << false;
+    QTest::newRow("cached") << true;
+}
+
+// Only the index cache is dropped for the cold runs, the files
+// themselves stay in the page cache.
+void TestDesktopEntries::indexStartup()
+{
+    QFETCH(bool, cached);
+
+    const QString cacheFile = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+                              + "/lingmo-dock/applications.cache";
+
+    // Leaves a fresh cache behind for the cached runs.
+    {
+        QFile::remove(cacheFile);
+        SystemAppMonitor monitor;
+        QVERIFY(monitor.find(applicationsDir() + "/org.example.Editor.desktop"));
+        QVERIFY(QFile::exists(cacheFile));
+    }
+
+    QBENCHMARK {
+        if (!cached)
+            QFile::remove(cacheFile);
+
+        SystemAppMonitor monitor;
+    }
+}
+
+// Drops the file from the page cache, which takes no privileges. Only
+// clean pages go, so freshly written files have to be synced first.
+bool TestDesktopEntries::evict(const QString &fileName, bool sync)
+{
+    const int fd = ::open(QFile::encodeName(fileName).constData(), O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1)
+        return false;
+
+    const bool ok = (!sync || ::fdatasync(fd) == 0)
+            && ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+
+    ::close(fd);
+    return ok;
+}
+
+void TestDesktopEntries::parseApplications_data()
+{
+    QTest::addColumn<bool>("parallel");
+    QTest::addColumn<bool>("cold");
+
+    QTest::newRow("serial, cold") << false << true;
+    QTest::newRow("parallel, cold") << true << true;
+    QTest::newRow("serial, warm") << false << false;
+    QTest::newRow("parallel, warm") << true << false;
+}
+
+// Every generated and fixture entry, parsed the way the monitor does at
+// startup. Cold runs evict the files before each iteration, the eviction
+// is timed as well but costs the same for both modes. Directory entries
+// and inodes stay cached, dropping those needs root.
+void TestDesktopEntries::parseApplications()
+{
+    QFETCH(bool, parallel);
+    QFETCH(bool, cold);
+
+    const QDir dir(applicationsDir());
+    QStringList filePaths;
+
+    for (const QString &fileName : dir.entryList({ "*.desktop" }, QDir::Files))
+        filePaths.append(dir.filePath(fileName));
+
+    QVERIFY(filePaths.size() > ApplicationsFixture::FillerCount);
+
+    for (const QString &filePath : qAsConst(filePaths))
+        QVERIFY(evict(filePath, true));
+
+    const QList<SystemAppMonitor::ParsedEntry> entries = SystemAppMonitor::parseApplications(filePaths, parallel);
+    QCOMPARE(entries.size(), filePaths.size());
+    QCOMPARE(std::count_if(entries.cbegin(), entries.cend(), [] (const SystemAppMonitor::ParsedEntry &entry) {
+                 return entry.visible;
+             }), qsizetype(filePaths.size() - 1));
+
+    QBENCHMARK {
+        if (cold) {
+            for (const QString &filePath : qAsConst(filePaths))
+                evict(filePath);
+        }
+
+        SystemAppMonitor::parseApplications(filePaths, parallel);
+    }
+}
+
+QTEST_GUILESS_MAIN(TestDesktopEntries)
+
+#include "tst_desktopentries.moc"
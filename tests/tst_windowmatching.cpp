@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2021 LingmoOS Team.
+ *
+ * Author:     rekols <revenmartin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtTest>
+
+#include "utils.h"
+
+#include "applicationsfixture.h"
+
+// Window to desktop file resolution, against the fixture applications.
+class TestWindowMatching : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void resolveDesktop_data();
+    void resolveDesktop();
+
+private:
+    ApplicationsFixture m_fixture;
+};
+
+void TestWindowMatching::initTestCase()
+{
+    QVERIFY(m_fixture.setUp());
+}
+
+void TestWindowMatching::resolveDesktop_data()
+{
+    QTest::addColumn<QString>("appId");
+    QTest::addColumn<QString>("wmClass");
+    QTest::addColumn<QString>("desktop");
+
+    QTest::newRow("startup wm class") << "exampleeditor" << "ExampleEditor" << "org.example.Editor.desktop";
+    QTest::newRow("desktop name") << "example-viewer" << "Example-viewer" << "example-viewer.desktop";
+    QTest::newRow("filler") << "filler-1500" << "Filler-1500" << "filler-1500.desktop";
+    QTest::newRow("unknown") << "nothing" << "Nothing" << QString();
+}
+
+void TestWindowMatching::resolveDesktop()
+{
+    QFETCH(QString, appId);
+    QFETCH(QString, wmClass);
+    QFETCH(QString, desktop);
+
+    Utils *utils = Utils::instance();
+    const quint32 pid = QCoreApplication::applicationPid();
+    const QString path = utils->desktopPathFromMetadata(appId, pid, wmClass);
+
+    if (desktop.isEmpty())
+        QVERIFY(path.isEmpty());
+    else
+        QCOMPARE(path, m_fixture.applicationsDir() + "/" + desktop);
+
+    // Memoized after the first call, like an application mapping one
+    // window after the other.
+    QBENCHMARK {
+        utils->resolveDesktop(appId, pid, wmClass);
+    }
+}
+
+QTEST_GUILESS_MAIN(TestWindowMatching)
+
+#include "tst_windowmatching.moc"